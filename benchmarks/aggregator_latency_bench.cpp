@@ -0,0 +1,87 @@
+/*
+ * aggregator_latency_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Latency distribution of aggregator::execute() under contention, by maximum batch size
+ *
+ *     g++ -O2 -std=c++11 -I../include aggregator_latency_bench.cpp -ltbb -pthread
+ *     ./a.out threads=16 ops=200000 work=50
+ *
+ * Every thread runs ops execute() calls whose body does work steps on shared state, for
+ * unbounded batches and for max_batch_size 1 to 256. Prints the execute() latency in
+ * nanoseconds over all calls, and the batching counters of the aggregator: a bounded batch
+ * should cut the tail that the thread stuck with a whole mailbox sees.
+ */
+
+#define TBB_PREVIEW_AGGREGATOR 1
+#include "benchmark_driver.h"
+#include "tbb/aggregator.h"
+
+namespace {
+
+struct shared_state {
+	unsigned long my_value;
+};
+
+class work_body {
+	shared_state& my_state;
+	const long my_work;
+public:
+	work_body(shared_state& state, long work) : my_state(state), my_work(work) {}
+	void operator()() const {
+		for (long i = 0; i < my_work; ++i)
+			my_state.my_value = my_state.my_value*6364136223846793005ul + 1442695040888963407ul;
+	}
+};
+
+class contention {
+	tbb::aggregator& my_aggregator;
+	shared_state& my_state;
+	const long my_ops;
+	const long my_work;
+	benchmark::distribution* my_latencies;
+public:
+	contention(tbb::aggregator& aggregator, shared_state& state, long ops, long work, benchmark::distribution* latencies) :
+		my_aggregator(aggregator), my_state(state), my_ops(ops), my_work(work), my_latencies(latencies) {}
+	void operator()(int t) const {
+		benchmark::distribution& latencies = my_latencies[t];
+		latencies.reserve(my_ops);
+		work_body body(my_state, my_work);
+		for (long i = 0; i < my_ops; ++i) {
+			tbb::tick_count t0 = tbb::tick_count::now();
+			my_aggregator.execute(body);
+			latencies.add(benchmark::nanoseconds(t0, tbb::tick_count::now()));
+		}
+	}
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int threads = int(benchmark::arg(argc, argv, "threads", benchmark::hardware_threads()));
+	long ops = benchmark::arg(argc, argv, "ops", 200000);
+	long work = benchmark::arg(argc, argv, "work", 50);
+	std::printf("threads=%d ops=%ld work=%ld\n", threads, ops, work);
+	static const size_t batch_sizes[] = {0, 1, 4, 16, 64, 256};
+	for (size_t b = 0; b < sizeof(batch_sizes)/sizeof(batch_sizes[0]); ++b) {
+		tbb::aggregator aggregator(batch_sizes[b], true);
+		shared_state state = {0};
+		std::vector<benchmark::distribution> latencies(threads);
+		double seconds = benchmark::run_threads(threads, contention(aggregator, state, ops, work, &latencies[0]));
+		char label[64] = "unbounded";
+		if (batch_sizes[b])
+			std::sprintf(label, "max_batch_size=%lu", (unsigned long)batch_sizes[b]);
+		benchmark::print_rate(label, double(threads)*ops, seconds);
+		benchmark::distribution all;
+		for (int t = 0; t < threads; ++t)
+			all.add(latencies[t]);
+		all.print("  execute ns");
+		tbb::aggregator_statistics s = aggregator.statistics();
+		std::printf("  batches=%lu handoffs=%lu operations=%lu largest_batch=%lu\n", (unsigned long)s.batches,
+			(unsigned long)s.handoffs, (unsigned long)s.operations, (unsigned long)s.largest_batch);
+	}
+	return 0;
+}
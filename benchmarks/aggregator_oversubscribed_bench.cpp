@@ -0,0 +1,100 @@
+/*
+ * aggregator_oversubscribed_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Throughput of aggregator::execute() with more threads than hardware threads
+ *
+ *     g++ -O2 -std=c++11 -I../include aggregator_oversubscribed_bench.cpp -ltbb -pthread
+ *     ./a.out max_factor=8 ops=100000 work=50
+ *
+ * Runs 1, 2, 4 ... max_factor threads per hardware thread, each doing ops updates of
+ * work steps on shared state, through the aggregator and, for reference, under a
+ * spin_mutex and a std::mutex. Besides the rate it prints the process CPU time per
+ * operation: waiters that keep spinning show up there, parked ones do not.
+ */
+
+#define TBB_PREVIEW_AGGREGATOR 1
+#include "benchmark_driver.h"
+#include "tbb/aggregator.h"
+#include "tbb/spin_mutex.h"
+#include <ctime>
+#include <mutex>
+
+namespace {
+
+struct shared_state {
+	unsigned long my_value;
+};
+
+class work_body {
+	shared_state& my_state;
+	const long my_work;
+public:
+	work_body(shared_state& state, long work) : my_state(state), my_work(work) {}
+	void operator()() const {
+		for (long i = 0; i < my_work; ++i)
+			my_state.my_value = my_state.my_value*6364136223846793005ul + 1442695040888963407ul;
+	}
+};
+
+class with_aggregator {
+	tbb::aggregator& my_aggregator;
+	const work_body& my_body;
+	const long my_ops;
+public:
+	with_aggregator(tbb::aggregator& aggregator, const work_body& body, long ops) : my_aggregator(aggregator), my_body(body), my_ops(ops) {}
+	void operator()(int) const {
+		for (long i = 0; i < my_ops; ++i)
+			my_aggregator.execute(my_body);
+	}
+};
+
+template <typename Mutex, typename Lock>
+class with_mutex {
+	Mutex& my_mutex;
+	const work_body& my_body;
+	const long my_ops;
+public:
+	with_mutex(Mutex& mutex, const work_body& body, long ops) : my_mutex(mutex), my_body(body), my_ops(ops) {}
+	void operator()(int) const {
+		for (long i = 0; i < my_ops; ++i) {
+			Lock lock(my_mutex);
+			my_body();
+		}
+	}
+};
+
+template <typename Body>
+void measure(const char* label, int threads, long ops, const Body& body) {
+	std::clock_t cpu = std::clock();
+	double seconds = benchmark::run_threads(threads, body);
+	double cpu_seconds = double(std::clock() - cpu)/CLOCKS_PER_SEC;
+	double operations = double(threads)*ops;
+	std::printf("%s threads=%d: %.3f s, %.2f Mops/s, %.0f ns CPU per operation\n", label, threads, seconds,
+		operations/seconds*1e-6, cpu_seconds/operations*1e9);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	long max_factor = benchmark::arg(argc, argv, "max_factor", 8);
+	long ops = benchmark::arg(argc, argv, "ops", 100000);
+	long work = benchmark::arg(argc, argv, "work", 50);
+	long hardware = benchmark::hardware_threads();
+	std::printf("threads=%ld ops=%ld work=%ld\n", hardware, ops, work);
+	shared_state state = {0};
+	work_body body(state, work);
+	for (long factor = 1; factor <= max_factor; factor *= 2) {
+		int threads = int(factor*hardware);
+		tbb::aggregator aggregator;
+		measure("aggregator", threads, ops, with_aggregator(aggregator, body, ops));
+		tbb::spin_mutex spin_mutex;
+		measure("spin_mutex", threads, ops, with_mutex<tbb::spin_mutex, tbb::spin_mutex::scoped_lock>(spin_mutex, body, ops));
+		std::mutex mutex;
+		measure("std::mutex", threads, ops, with_mutex<std::mutex, std::lock_guard<std::mutex> >(mutex, body, ops));
+	}
+	return 0;
+}
@@ -0,0 +1,120 @@
+/*
+ * benchmark_driver.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef BENCHMARKS_BENCHMARK_DRIVER_H_
+#define BENCHMARKS_BENCHMARK_DRIVER_H_
+
+/*
+ * Shared pieces of the programs in benchmarks/
+ *
+ * Every program is a single translation unit built against the headers in include/
+ * and the TBB runtime, for example
+ *     g++ -O2 -std=c++11 -I../include queue_throughput.cpp -ltbb -pthread
+ * Parameters are given as name=value on the command line, each with a default, and
+ * results are printed one line per configuration so that runs can be diffed.
+ */
+
+#include "tbb/tbb_thread.h"
+#include "tbb/tick_count.h"
+#include "tbb/atomic.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace benchmark {
+
+// Value of name=value among the arguments, or the default
+inline long arg(int argc, char* argv[], const char* name, long default_value) {
+	size_t length = std::strlen(name);
+	for (int i = 1; i < argc; ++i)
+		if (std::strncmp(argv[i], name, length) == 0 && argv[i][length] == '=')
+			return std::atol(argv[i] + length + 1);
+	return default_value;
+}
+
+inline long hardware_threads() {
+	unsigned n = tbb::tbb_thread::hardware_concurrency();
+	return n ? n : 1;
+}
+
+// Runs body(t) on threads 0..n_threads-1, released together, and returns the seconds
+// from the release until the last thread is done
+template <typename Body>
+class team_run : tbb::internal::no_copy {
+	struct worker {
+		team_run* my_run;
+		int my_index;
+		void operator()() const {
+			++my_run->my_ready;
+			while (!my_run->my_go) tbb::this_tbb_thread::yield();
+			my_run->my_body(my_index);
+		}
+	};
+	const Body& my_body;
+	tbb::atomic<int> my_ready;
+	tbb::atomic<bool> my_go;
+public:
+	explicit team_run(const Body& body) : my_body(body) {
+		my_ready = 0;
+		my_go = false;
+	}
+	double operator()(int n_threads) {
+		std::vector<tbb::tbb_thread*> threads;
+		for (int t = 0; t < n_threads; ++t) {
+			worker w = {this, t};
+			threads.push_back(new tbb::tbb_thread(w));
+		}
+		while (my_ready < n_threads) tbb::this_tbb_thread::yield();
+		tbb::tick_count t0 = tbb::tick_count::now();
+		my_go = true;
+		for (size_t t = 0; t < threads.size(); ++t) {
+			threads[t]->join();
+			delete threads[t];
+		}
+		return (tbb::tick_count::now() - t0).seconds();
+	}
+};
+
+template <typename Body>
+double run_threads(int n_threads, const Body& body) {
+	team_run<Body> run(body);
+	return run(n_threads);
+}
+
+// Samples of one quantity, e.g. the latency of single operations in nanoseconds
+class distribution {
+	std::vector<double> my_samples;
+public:
+	void reserve(size_t n) { my_samples.reserve(n); }
+	void add(double sample) { my_samples.push_back(sample); }
+	void add(const distribution& other) { my_samples.insert(my_samples.end(), other.my_samples.begin(), other.my_samples.end()); }
+	size_t size() const { return my_samples.size(); }
+	// Sample at fraction q of the sorted samples, q in [0,1]
+	double percentile(double q) {
+		if (my_samples.empty()) return 0;
+		std::sort(my_samples.begin(), my_samples.end());
+		size_t i = size_t(q*(my_samples.size() - 1) + 0.5);
+		return my_samples[i];
+	}
+	void print(const char* label) {
+		std::printf("%s: n=%lu p50=%.0f p90=%.0f p99=%.0f p99.9=%.0f max=%.0f\n", label, (unsigned long)size(),
+			percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), percentile(1));
+	}
+};
+
+inline double nanoseconds(const tbb::tick_count& t0, const tbb::tick_count& t1) {
+	return (t1 - t0).seconds()*1e9;
+}
+
+inline void print_rate(const char* label, double operations, double seconds) {
+	std::printf("%s: %.3f s, %.2f Mops/s\n", label, seconds, operations/seconds*1e-6);
+}
+
+} // namespace benchmark
+
+#endif /* BENCHMARKS_BENCHMARK_DRIVER_H_ */
@@ -0,0 +1,79 @@
+/*
+ * bounded_queue_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Producer/consumer throughput of concurrent_bounded_queue
+ *
+ *     g++ -O2 -std=c++11 -I../include bounded_queue_bench.cpp -ltbb -pthread
+ *     ./a.out producers=4 consumers=4 items=1000000
+ *
+ * producers threads push items ints each with push(), consumers threads take them with
+ * the blocking pop(). Run with capacities from a few items, where both sides park on
+ * the futex most of the time, up to an unbounded queue. The consumers check the sum
+ * of what they got.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+
+namespace {
+
+class producer_consumer {
+	tbb::concurrent_bounded_queue<long>& my_queue;
+	const int my_producers;
+	const int my_consumers;
+	const long my_items;
+	tbb::atomic<long>& my_sum;
+	tbb::atomic<int>& my_producers_left;
+public:
+	producer_consumer(tbb::concurrent_bounded_queue<long>& queue, int producers, int consumers, long items,
+			tbb::atomic<long>& sum, tbb::atomic<int>& left) :
+		my_queue(queue), my_producers(producers), my_consumers(consumers), my_items(items), my_sum(sum), my_producers_left(left) {}
+	void operator()(int t) const {
+		if (t < my_producers) {
+			for (long i = 1; i <= my_items; ++i)
+				my_queue.push(i);
+			// The last producer sends one end marker per consumer
+			if (--my_producers_left == 0)
+				for (int c = 0; c < my_consumers; ++c)
+					my_queue.push(-1);
+			return;
+		}
+		long sum = 0;
+		for (long item; my_queue.pop(item), item >= 0;)
+			sum += item;
+		my_sum += sum;
+	}
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int producers = int(benchmark::arg(argc, argv, "producers", 2));
+	int consumers = int(benchmark::arg(argc, argv, "consumers", 2));
+	long items = benchmark::arg(argc, argv, "items", 1000000);
+	std::printf("threads=%ld producers=%d consumers=%d items=%ld\n", benchmark::hardware_threads(), producers, consumers, items);
+	static const long capacities[] = {4, 64, 1024, 65536, 0};
+	for (size_t c = 0; c < sizeof(capacities)/sizeof(capacities[0]); ++c) {
+		tbb::concurrent_bounded_queue<long> queue;
+		if (capacities[c])
+			queue.set_capacity(capacities[c]);
+		tbb::atomic<long> sum;
+		tbb::atomic<int> left;
+		sum = 0;
+		left = producers;
+		double seconds = benchmark::run_threads(producers + consumers, producer_consumer(queue, producers, consumers, items, sum, left));
+		if (sum != producers*(items*(items + 1)/2)) {
+			std::printf("capacity=%ld: lost items\n", capacities[c]);
+			return 1;
+		}
+		char label[64] = "unbounded";
+		if (capacities[c])
+			std::sprintf(label, "capacity=%ld", capacities[c]);
+		benchmark::print_rate(label, double(producers)*items, seconds);
+	}
+	return 0;
+}
@@ -0,0 +1,99 @@
+/*
+ * bulk_construction_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Where parallel bulk construction starts to pay, for a POD and a non-POD element
+ *
+ *     g++ -O2 -std=c++11 -I../include bulk_construction_bench.cpp -ltbb -pthread
+ *     ./a.out min_kb=64 max_kb=65536 reps=5
+ *
+ * For every size, copy constructs that many bytes of elements into raw storage with a
+ * plain loop and with parallel_chunk_invoke (the chunks concurrent_vector uses), then
+ * copy constructs a whole concurrent_vector, which picks the parallel path only from
+ * parallel_construction_threshold bytes on. Times are the best of reps, in microseconds.
+ * The smallest size where "parallel" beats "serial" is the threshold to use.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_vector.h"
+#include "tbb/internal/_parallel_chunk_impl.h"
+#include <new>
+#include <string>
+
+namespace {
+
+// Bytes of elements per chunk, as parallel_construction_grainsize of concurrent_vector
+const size_t chunk_bytes = 1<<16;
+
+template <typename T>
+class copy_body {
+	const T* my_src;
+	T* my_dst;
+public:
+	copy_body(const T* src, T* dst) : my_src(src), my_dst(dst) {}
+	void operator()(size_t begin, size_t end) const {
+		for (size_t i = begin; i < end; ++i)
+			new(my_dst + i) T(my_src[i]);
+	}
+};
+
+template <typename T>
+class destroy_body {
+	T* my_array;
+public:
+	explicit destroy_body(T* array) : my_array(array) {}
+	void operator()(size_t begin, size_t end) const {
+		for (size_t i = begin; i < end; ++i)
+			my_array[i].~T();
+	}
+};
+
+template <typename T>
+void measure(const char* type, size_t bytes, const T& value, long reps) {
+	size_t n = bytes/sizeof(T);
+	std::vector<T> src(n, value);
+	T* dst = static_cast<T*>(operator new(n*sizeof(T)));
+	tbb::concurrent_vector<T> vector_src(n, value);
+	copy_body<T> copy(&src[0], dst);
+	destroy_body<T> destroy(dst);
+	double serial = 1e30, parallel = 1e30, vector_copy = 1e30;
+	for (long r = 0; r < reps; ++r) {
+		tbb::tick_count t0 = tbb::tick_count::now();
+		copy(0, n);
+		tbb::tick_count t1 = tbb::tick_count::now();
+		destroy(0, n);
+		tbb::tick_count t2 = tbb::tick_count::now();
+		tbb::internal::parallel_chunk_invoke(n, chunk_bytes/sizeof(T), copy);
+		tbb::tick_count t3 = tbb::tick_count::now();
+		destroy(0, n);
+		tbb::tick_count t4 = tbb::tick_count::now();
+		{
+			tbb::concurrent_vector<T> vector(vector_src);
+			vector_copy = std::min(vector_copy, (tbb::tick_count::now() - t4).seconds());
+		}
+		serial = std::min(serial, (t1 - t0).seconds());
+		parallel = std::min(parallel, (t3 - t2).seconds());
+	}
+	operator delete(dst);
+	std::printf("%s bytes=%lu: serial %.1f us, parallel %.1f us, concurrent_vector copy %.1f us\n", type,
+		(unsigned long)bytes, serial*1e6, parallel*1e6, vector_copy*1e6);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	long min_kb = benchmark::arg(argc, argv, "min_kb", 64);
+	long max_kb = benchmark::arg(argc, argv, "max_kb", 65536);
+	long reps = benchmark::arg(argc, argv, "reps", 5);
+	std::printf("threads=%ld\n", benchmark::hardware_threads());
+	for (long kb = min_kb; kb <= max_kb; kb *= 2)
+		measure("int", size_t(kb)*1024, 1, reps);
+	// Longer than the small string buffer, so every copy allocates
+	std::string text(40, 'x');
+	for (long kb = min_kb; kb <= max_kb; kb *= 2)
+		measure("std::string", size_t(kb)*1024, text, reps);
+	return 0;
+}
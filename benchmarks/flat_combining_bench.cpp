@@ -0,0 +1,156 @@
+/*
+ * flat_combining_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Flat-combining containers against the same sequential containers behind a lock
+ *
+ *     g++ -O2 -std=c++11 -I../include flat_combining_bench.cpp -ltbb -pthread
+ *     ./a.out max_threads=32 ops=200000 keys=4096
+ *
+ * For every power of two thread count up to max_threads:
+ *   stack           push() then try_pop() per step, flat_combining_stack against std::vector
+ *   priority_queue  the same on concurrent_priority_queue against std::priority_queue
+ *   set             insert, contains, erase of random keys below keys, flat_combining_set
+ *                   against std::set
+ * The lock-based versions take a std::mutex around every operation.
+ */
+
+#define TBB_PREVIEW_AGGREGATOR 1
+#include "benchmark_driver.h"
+#include "tbb/flat_combining.h"
+#include "tbb/concurrent_priority_queue.h"
+#include <mutex>
+#include <queue>
+#include <set>
+
+namespace {
+
+// The lock-based equivalents, with the interface of the flat-combining ones
+class locked_stack {
+	std::mutex my_mutex;
+	std::vector<long> my_items;
+public:
+	void push(long item) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		my_items.push_back(item);
+	}
+	bool try_pop(long& item) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		if (my_items.empty()) return false;
+		item = my_items.back();
+		my_items.pop_back();
+		return true;
+	}
+};
+
+class locked_priority_queue {
+	std::mutex my_mutex;
+	std::priority_queue<long> my_items;
+public:
+	void push(long item) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		my_items.push(item);
+	}
+	bool try_pop(long& item) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		if (my_items.empty()) return false;
+		item = my_items.top();
+		my_items.pop();
+		return true;
+	}
+};
+
+class locked_set {
+	std::mutex my_mutex;
+	std::set<long> my_keys;
+public:
+	bool insert(long key) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		return my_keys.insert(key).second;
+	}
+	bool erase(long key) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		return my_keys.erase(key) != 0;
+	}
+	bool contains(long key) {
+		std::lock_guard<std::mutex> lock(my_mutex);
+		return my_keys.count(key) != 0;
+	}
+};
+
+template <typename Container>
+class push_pop {
+	Container& my_container;
+	const long my_ops;
+public:
+	push_pop(Container& container, long ops) : my_container(container), my_ops(ops) {}
+	void operator()(int t) const {
+		long item;
+		for (long i = 0; i < my_ops; ++i) {
+			my_container.push(t*my_ops + i);
+			my_container.try_pop(item);
+		}
+	}
+};
+
+template <typename Set>
+class set_mix {
+	Set& my_set;
+	const long my_ops;
+	const long my_keys;
+public:
+	set_mix(Set& set, long ops, long keys) : my_set(set), my_ops(ops), my_keys(keys) {}
+	void operator()(int t) const {
+		unsigned state = unsigned(t)*2654435761u + 1;
+		for (long i = 0; i < my_ops; ++i) {
+			state = state*1664525u + 1013904223u;
+			long key = long((state >> 8) % unsigned(my_keys));
+			switch (i % 3) {
+			case 0: my_set.insert(key); break;
+			case 1: my_set.contains(key); break;
+			default: my_set.erase(key); break;
+			}
+		}
+	}
+};
+
+void print(const char* container, const char* kind, int threads, double operations, double seconds) {
+	char label[64];
+	std::sprintf(label, "%s %s threads=%d", container, kind, threads);
+	benchmark::print_rate(label, operations, seconds);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int max_threads = int(benchmark::arg(argc, argv, "max_threads", benchmark::hardware_threads()));
+	long ops = benchmark::arg(argc, argv, "ops", 200000);
+	long keys = benchmark::arg(argc, argv, "keys", 4096);
+	std::printf("threads=%ld ops=%ld keys=%ld\n", benchmark::hardware_threads(), ops, keys);
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		double operations = 2.0*threads*ops;
+		{
+			tbb::flat_combining_stack<long> stack;
+			print("stack", "flat_combining", threads, operations, benchmark::run_threads(threads, push_pop<tbb::flat_combining_stack<long> >(stack, ops)));
+			locked_stack locked;
+			print("stack", "std::mutex", threads, operations, benchmark::run_threads(threads, push_pop<locked_stack>(locked, ops)));
+		}
+		{
+			tbb::concurrent_priority_queue<long> queue;
+			print("priority_queue", "flat_combining", threads, operations,
+				benchmark::run_threads(threads, push_pop<tbb::concurrent_priority_queue<long> >(queue, ops)));
+			locked_priority_queue locked;
+			print("priority_queue", "std::mutex", threads, operations, benchmark::run_threads(threads, push_pop<locked_priority_queue>(locked, ops)));
+		}
+		{
+			tbb::flat_combining_set<long> set;
+			print("set", "flat_combining", threads, double(threads)*ops, benchmark::run_threads(threads, set_mix<tbb::flat_combining_set<long> >(set, ops, keys)));
+			locked_set locked;
+			print("set", "std::mutex", threads, double(threads)*ops, benchmark::run_threads(threads, set_mix<locked_set>(locked, ops, keys)));
+		}
+	}
+	return 0;
+}
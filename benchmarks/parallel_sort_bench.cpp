@@ -0,0 +1,90 @@
+/*
+ * parallel_sort_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * tbb::parallel_sort of a concurrent_vector against std::sort of a std::vector
+ *
+ *     g++ -O2 -std=c++11 -I../include parallel_sort_bench.cpp -ltbb -pthread
+ *     ./a.out n=100000000 check_reps=5
+ *
+ * First sorts std::string vectors of the sizes around the block and chunk edges and
+ * compares them with std::sort: strings are not trivially movable, so a merge that
+ * reads an element another thread has already moved from shows up as a wrong order.
+ * Then times both sorts on n random ints. Exits with 1 on any mismatch.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_vector.h"
+#include "tbb/parallel_sort.h"
+#include <string>
+
+namespace {
+
+unsigned next_random(unsigned& state) {
+	state = state*1664525u + 1013904223u;
+	return state >> 8;
+}
+
+template <typename T, typename Generate>
+bool sorts_like_std_sort(size_t n, unsigned seed, Generate generate) {
+	tbb::concurrent_vector<T> vector(n);
+	std::vector<T> expected(n);
+	for (size_t i = 0; i < n; ++i)
+		expected[i] = vector[i] = generate(seed);
+	tbb::parallel_sort(vector);
+	std::sort(expected.begin(), expected.end());
+	for (size_t i = 0; i < n; ++i)
+		if (!(vector[i] == expected[i]))
+			return false;
+	return true;
+}
+
+std::string random_string(unsigned& state) {
+	char buffer[40];
+	std::sprintf(buffer, "%u-%u", next_random(state) % 1000, next_random(state));
+	// Long enough not to fit in the small string buffer, so moving from it empties it
+	return std::string(buffer) + std::string(24, 'x');
+}
+
+int random_int(unsigned& state) {
+	return int(next_random(state));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	long n = benchmark::arg(argc, argv, "n", 100000000);
+	long reps = benchmark::arg(argc, argv, "check_reps", 5);
+	std::printf("threads=%ld\n", benchmark::hardware_threads());
+
+	static const size_t check_sizes[] = {100, 255, 256, 257, 1000, 5000, 33333, 100001};
+	for (size_t s = 0; s < sizeof(check_sizes)/sizeof(check_sizes[0]); ++s)
+		for (long r = 0; r < reps; ++r)
+			if (!sorts_like_std_sort<std::string>(check_sizes[s], unsigned(r), random_string)) {
+				std::printf("std::string n=%lu rep=%ld: wrong order\n", (unsigned long)check_sizes[s], r);
+				return 1;
+			}
+	std::printf("std::string check: ok\n");
+
+	tbb::concurrent_vector<int> vector(n);
+	std::vector<int> expected(n);
+	unsigned state = 1;
+	for (long i = 0; i < n; ++i)
+		expected[i] = vector[i] = random_int(state);
+	tbb::tick_count t0 = tbb::tick_count::now();
+	tbb::parallel_sort(vector);
+	tbb::tick_count t1 = tbb::tick_count::now();
+	std::sort(expected.begin(), expected.end());
+	tbb::tick_count t2 = tbb::tick_count::now();
+	for (long i = 0; i < n; ++i)
+		if (vector[i] != expected[i]) {
+			std::printf("int n=%ld: wrong order at %ld\n", n, i);
+			return 1;
+		}
+	std::printf("int n=%ld: parallel_sort %.3f s, std::sort %.3f s, speedup %.2f\n", n,
+		(t1 - t0).seconds(), (t2 - t1).seconds(), (t2 - t1).seconds()/(t1 - t0).seconds());
+	return 0;
+}
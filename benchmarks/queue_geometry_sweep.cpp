@@ -0,0 +1,62 @@
+/*
+ * queue_geometry_sweep.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Throughput of concurrent_queue over its n_queue and items_per_page parameters
+ *
+ *     g++ -O2 -std=c++11 -I../include queue_geometry_sweep.cpp -ltbb -pthread
+ *     ./a.out threads=128 ops=200000 max_queues=64
+ *
+ * Every thread alternates push() and try_pop() ops times on one shared queue, for each
+ * power of two n_queue from 2 to max_queues and items_per_page from 4 to 64. Prints one
+ * line per pair and the fastest pair last; use it to pick the geometry for a deployment.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+
+namespace {
+
+class push_pop {
+	tbb::concurrent_queue<long>& my_queue;
+	const long my_ops;
+public:
+	push_pop(tbb::concurrent_queue<long>& queue, long ops) : my_queue(queue), my_ops(ops) {}
+	void operator()(int t) const {
+		long item;
+		for (long i = 0; i < my_ops; ++i) {
+			my_queue.push(t*my_ops + i);
+			my_queue.try_pop(item);
+		}
+	}
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int threads = int(benchmark::arg(argc, argv, "threads", benchmark::hardware_threads()));
+	long ops = benchmark::arg(argc, argv, "ops", 200000);
+	long max_queues = benchmark::arg(argc, argv, "max_queues", 64);
+	std::printf("threads=%d ops=%ld\n", threads, ops);
+	double best = 0;
+	long best_queues = 0, best_page = 0;
+	for (long n_queue = 2; n_queue <= max_queues; n_queue *= 2)
+		for (long items_per_page = 4; items_per_page <= 64; items_per_page *= 2) {
+			tbb::concurrent_queue<long> queue(n_queue, items_per_page);
+			double seconds = benchmark::run_threads(threads, push_pop(queue, ops));
+			double rate = 2.0*threads*ops/seconds;
+			char label[64];
+			std::sprintf(label, "n_queue=%ld items_per_page=%ld", n_queue, items_per_page);
+			benchmark::print_rate(label, 2.0*threads*ops, seconds);
+			if (rate > best) {
+				best = rate;
+				best_queues = n_queue;
+				best_page = items_per_page;
+			}
+		}
+	std::printf("fastest: n_queue=%ld items_per_page=%ld, %.2f Mops/s\n", best_queues, best_page, best*1e-6);
+	return 0;
+}
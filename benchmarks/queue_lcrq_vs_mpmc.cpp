@@ -0,0 +1,94 @@
+/*
+ * queue_lcrq_vs_mpmc.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * concurrent_queue with queue_lcrq against the default micro-queue policy, queue_mpmc
+ *
+ *     g++ -O2 -std=c++11 -mcx16 -I../include queue_lcrq_vs_mpmc.cpp -ltbb -pthread
+ *     ./a.out max_threads=64 ops=1000000
+ *
+ * Two workloads for every power of two thread count up to max_threads:
+ *   pairs  every thread alternates push() and try_pop(), so the queue stays short
+ *   split  half the threads push ops items each, the other half pop them all
+ * queue_lcrq needs a 16 byte CAS (__TBB_CAS16_PRESENT); without one only queue_mpmc runs.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+
+namespace {
+
+template <typename Queue>
+class pairs {
+	Queue& my_queue;
+	const long my_ops;
+public:
+	pairs(Queue& queue, long ops) : my_queue(queue), my_ops(ops) {}
+	void operator()(int t) const {
+		long item;
+		for (long i = 0; i < my_ops; ++i) {
+			my_queue.push(t*my_ops + i);
+			my_queue.try_pop(item);
+		}
+	}
+};
+
+template <typename Queue>
+class split {
+	Queue& my_queue;
+	const int my_producers;
+	const long my_ops;
+	tbb::atomic<long>& my_popped;
+public:
+	split(Queue& queue, int producers, long ops, tbb::atomic<long>& popped) :
+		my_queue(queue), my_producers(producers), my_ops(ops), my_popped(popped) {}
+	void operator()(int t) const {
+		if (t < my_producers) {
+			for (long i = 0; i < my_ops; ++i)
+				my_queue.push(i);
+			return;
+		}
+		long item, total = my_producers*my_ops;
+		while (my_popped < total)
+			if (my_queue.try_pop(item))
+				++my_popped;
+	}
+};
+
+template <typename Policy>
+void measure(const char* policy, int threads, long ops) {
+	typedef tbb::concurrent_queue<long, tbb::cache_aligned_allocator<long>, Policy> queue_type;
+	char label[64];
+	{
+		queue_type queue;
+		std::sprintf(label, "%s pairs threads=%d", policy, threads);
+		benchmark::print_rate(label, 2.0*threads*ops, benchmark::run_threads(threads, pairs<queue_type>(queue, ops)));
+	}
+	if (threads > 1) {
+		queue_type queue;
+		tbb::atomic<long> popped;
+		popped = 0;
+		int producers = threads/2;
+		std::sprintf(label, "%s split threads=%d", policy, threads);
+		benchmark::print_rate(label, 2.0*producers*ops,
+			benchmark::run_threads(2*producers, split<queue_type>(queue, producers, ops, popped)));
+	}
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int max_threads = int(benchmark::arg(argc, argv, "max_threads", benchmark::hardware_threads()));
+	long ops = benchmark::arg(argc, argv, "ops", 1000000);
+	std::printf("threads=%ld ops=%ld\n", benchmark::hardware_threads(), ops);
+	for (int threads = 1; threads <= max_threads; threads *= 2) {
+		measure<tbb::queue_mpmc>("queue_mpmc", threads, ops);
+#if __TBB_CAS16_PRESENT
+		measure<tbb::queue_lcrq>("queue_lcrq", threads, ops);
+#endif
+	}
+	return 0;
+}
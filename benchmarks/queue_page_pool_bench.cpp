@@ -0,0 +1,114 @@
+/*
+ * queue_page_pool_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Allocator calls and push latency of a concurrent_queue carrying a steady stream
+ *
+ *     g++ -O2 -std=c++11 -I../include queue_page_pool_bench.cpp -ltbb -pthread
+ *     ./a.out pairs=2 items=1000000 items_per_page=32
+ *
+ * pairs producer threads push items ints each and as many consumer threads pop them, so
+ * the queue crosses a page boundary every items_per_page items of a micro-queue. The
+ * allocator counts its calls: without the page pool there is one allocation and one
+ * deallocation per page crossed, with it only the pages in flight are ever allocated.
+ * The latency of every push is recorded in nanoseconds.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+#include <new>
+
+namespace {
+
+tbb::atomic<long> allocations, deallocations;
+
+template <typename T>
+class counting_allocator {
+public:
+	typedef T value_type;
+	typedef T* pointer;
+	typedef const T* const_pointer;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <typename U> struct rebind {typedef counting_allocator<U> other;};
+
+	counting_allocator() {}
+	template <typename U> counting_allocator(const counting_allocator<U>&) {}
+
+	pointer allocate(size_type n, const void* = NULL) {
+		++allocations;
+		return static_cast<pointer>(operator new(n*sizeof(T)));
+	}
+	void deallocate(pointer p, size_type) {
+		++deallocations;
+		operator delete(p);
+	}
+	void construct(pointer p, const T& value) {new(p) T(value);}
+	void destroy(pointer p) {p->~T();}
+};
+
+template <typename T, typename U>
+bool operator==(const counting_allocator<T>&, const counting_allocator<U>&) {return true;}
+template <typename T, typename U>
+bool operator!=(const counting_allocator<T>&, const counting_allocator<U>&) {return false;}
+
+typedef tbb::concurrent_queue<long, counting_allocator<long> > queue_type;
+
+class stream {
+	queue_type& my_queue;
+	const int my_pairs;
+	const long my_items;
+	benchmark::distribution* my_latencies;
+	tbb::atomic<long>& my_popped;
+public:
+	stream(queue_type& queue, int pairs, long items, benchmark::distribution* latencies, tbb::atomic<long>& popped) :
+		my_queue(queue), my_pairs(pairs), my_items(items), my_latencies(latencies), my_popped(popped) {}
+	void operator()(int t) const {
+		if (t < my_pairs) {
+			benchmark::distribution& latencies = my_latencies[t];
+			latencies.reserve(my_items);
+			for (long i = 0; i < my_items; ++i) {
+				tbb::tick_count t0 = tbb::tick_count::now();
+				my_queue.push(i);
+				latencies.add(benchmark::nanoseconds(t0, tbb::tick_count::now()));
+			}
+			return;
+		}
+		long item, total = my_pairs*my_items;
+		while (my_popped < total)
+			if (my_queue.try_pop(item))
+				++my_popped;
+	}
+};
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int pairs = int(benchmark::arg(argc, argv, "pairs", 2));
+	long items = benchmark::arg(argc, argv, "items", 1000000);
+	long items_per_page = benchmark::arg(argc, argv, "items_per_page", 32);
+	std::printf("threads=%ld pairs=%d items=%ld items_per_page=%ld\n", benchmark::hardware_threads(), pairs, items, items_per_page);
+	allocations = 0;
+	deallocations = 0;
+	std::vector<benchmark::distribution> latencies(pairs);
+	tbb::atomic<long> popped;
+	popped = 0;
+	double seconds;
+	{
+		queue_type queue(0, size_t(items_per_page));
+		seconds = benchmark::run_threads(2*pairs, stream(queue, pairs, items, &latencies[0], popped));
+	}
+	std::printf("pages crossed: %ld, allocations: %ld, deallocations: %ld\n",
+		long(pairs)*items/items_per_page, long(allocations), long(deallocations));
+	benchmark::print_rate("push+pop", double(pairs)*items, seconds);
+	benchmark::distribution all;
+	for (int p = 0; p < pairs; ++p)
+		all.add(latencies[p]);
+	all.print("push latency ns");
+	return 0;
+}
@@ -0,0 +1,69 @@
+/*
+ * queue_policies_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * The single consumer policies of concurrent_queue against queue_mpmc
+ *
+ *     g++ -O2 -std=c++11 -I../include queue_policies_bench.cpp -ltbb -pthread
+ *     ./a.out max_producers=16 items=2000000
+ *
+ * Thread 0 pops while the other threads push items ints each:
+ *   spsc  one producer, queue_spsc, queue_mpsc and queue_mpmc on the same stream
+ *   mpsc  1, 2, 4 ... max_producers producers, queue_mpsc against queue_mpmc
+ * The rate counts pushes and pops.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+
+namespace {
+
+template <typename Queue>
+class stream {
+	Queue& my_queue;
+	const int my_producers;
+	const long my_items;
+public:
+	stream(Queue& queue, int producers, long items) : my_queue(queue), my_producers(producers), my_items(items) {}
+	void operator()(int t) const {
+		if (t > 0) {
+			for (long i = 0; i < my_items; ++i)
+				my_queue.push(i);
+			return;
+		}
+		long item;
+		for (long popped = 0, total = my_producers*my_items; popped < total;)
+			if (my_queue.try_pop(item))
+				++popped;
+	}
+};
+
+template <typename Policy>
+void measure(const char* workload, const char* policy, int producers, long items) {
+	typedef tbb::concurrent_queue<long, tbb::cache_aligned_allocator<long>, Policy> queue_type;
+	queue_type queue;
+	char label[64];
+	std::sprintf(label, "%s %s producers=%d", workload, policy, producers);
+	benchmark::print_rate(label, 2.0*producers*items,
+		benchmark::run_threads(producers + 1, stream<queue_type>(queue, producers, items)));
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	long hardware = benchmark::hardware_threads();
+	int max_producers = int(benchmark::arg(argc, argv, "max_producers", hardware > 1 ? hardware - 1 : 1));
+	long items = benchmark::arg(argc, argv, "items", 2000000);
+	std::printf("threads=%ld items=%ld\n", hardware, items);
+	measure<tbb::queue_spsc>("spsc", "queue_spsc", 1, items);
+	measure<tbb::queue_mpsc>("spsc", "queue_mpsc", 1, items);
+	measure<tbb::queue_mpmc>("spsc", "queue_mpmc", 1, items);
+	for (int producers = 1; producers <= max_producers; producers *= 2) {
+		measure<tbb::queue_mpsc>("mpsc", "queue_mpsc", producers, items);
+		measure<tbb::queue_mpmc>("mpsc", "queue_mpmc", producers, items);
+	}
+	return 0;
+}
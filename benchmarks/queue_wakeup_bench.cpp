@@ -0,0 +1,101 @@
+/*
+ * queue_wakeup_bench.cpp
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+/*
+ * Wakeup latency and CPU use of concurrent_bounded_queue consumers under bursty load
+ *
+ *     g++ -O2 -std=c++11 -I../include queue_wakeup_bench.cpp -ltbb -pthread
+ *     ./a.out consumers=8 bursts=2000 burst=16 gap_us=500
+ *
+ * One producer pushes bursts of burst time-stamped items and sleeps gap_us microseconds
+ * between them, so the consumers spend most of the run parked. Every consumer waits with
+ * pop(), then again with pop_for() and a 10 ms timeout. Prints the latency from push to
+ * pop in nanoseconds, which is mostly the time to wake a parked consumer, and the process
+ * CPU time against the wall time: consumers that spin through the gaps show up there.
+ */
+
+#include "benchmark_driver.h"
+#include "tbb/concurrent_queue.h"
+#include <ctime>
+
+namespace {
+
+struct stamped_item {
+	tbb::tick_count pushed;
+	// Tells a consumer to stop
+	bool last;
+};
+
+typedef tbb::concurrent_bounded_queue<stamped_item> queue_type;
+
+class bursty_load {
+	queue_type& my_queue;
+	const int my_consumers;
+	const long my_bursts;
+	const long my_burst;
+	const double my_gap;
+	const bool my_timed;
+	benchmark::distribution* my_latencies;
+public:
+	bursty_load(queue_type& queue, int consumers, long bursts, long burst, double gap, bool timed, benchmark::distribution* latencies) :
+		my_queue(queue), my_consumers(consumers), my_bursts(bursts), my_burst(burst), my_gap(gap), my_timed(timed), my_latencies(latencies) {}
+	void operator()(int t) const {
+		if (t == 0) {
+			stamped_item item;
+			item.last = false;
+			for (long b = 0; b < my_bursts; ++b) {
+				for (long i = 0; i < my_burst; ++i) {
+					item.pushed = tbb::tick_count::now();
+					my_queue.push(item);
+				}
+				tbb::this_tbb_thread::sleep(tbb::tick_count::interval_t(my_gap));
+			}
+			item.last = true;
+			for (int c = 0; c < my_consumers; ++c)
+				my_queue.push(item);
+			return;
+		}
+		benchmark::distribution& latencies = my_latencies[t-1];
+		latencies.reserve(my_bursts*my_burst/my_consumers);
+		for (stamped_item item;;) {
+			if (my_timed) {
+				if (!my_queue.pop_for(item, tbb::tick_count::interval_t(0.01)))
+					continue;
+			} else {
+				my_queue.pop(item);
+			}
+			if (item.last)
+				return;
+			latencies.add(benchmark::nanoseconds(item.pushed, tbb::tick_count::now()));
+		}
+	}
+};
+
+void measure(const char* label, int consumers, long bursts, long burst, double gap, bool timed) {
+	queue_type queue;
+	std::vector<benchmark::distribution> latencies(consumers);
+	std::clock_t cpu = std::clock();
+	double seconds = benchmark::run_threads(consumers + 1, bursty_load(queue, consumers, bursts, burst, gap, timed, &latencies[0]));
+	double cpu_seconds = double(std::clock() - cpu)/CLOCKS_PER_SEC;
+	std::printf("%s: %.3f s wall, %.3f s CPU (%.2f threads busy)\n", label, seconds, cpu_seconds, cpu_seconds/seconds);
+	benchmark::distribution all;
+	for (int c = 0; c < consumers; ++c)
+		all.add(latencies[c]);
+	all.print("  push to pop ns");
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+	int consumers = int(benchmark::arg(argc, argv, "consumers", benchmark::hardware_threads()));
+	long bursts = benchmark::arg(argc, argv, "bursts", 2000);
+	long burst = benchmark::arg(argc, argv, "burst", 16);
+	long gap_us = benchmark::arg(argc, argv, "gap_us", 500);
+	std::printf("threads=%ld consumers=%d bursts=%ld burst=%ld gap_us=%ld\n", benchmark::hardware_threads(), consumers, bursts, burst, gap_us);
+	measure("pop", consumers, bursts, burst, gap_us*1e-6, false);
+	measure("pop_for", consumers, bursts, burst, gap_us*1e-6, true);
+	return 0;
+}
@@ -14,6 +14,9 @@
 
 #include "atomic.h"
 #include "tbb_profiling.h"
+#include "tick_count.h"
+#include "internal/_futex_impl.h"
+#include "internal/_latency_histogram_impl.h"
 
 namespace tbb {
 namespace interface6 {
@@ -21,15 +24,35 @@ namespace interface6 {
 using namespace tbb::internal;
 class aggregator_operation {
 	template<typename handler_type> friend class aggregator_ext;
-	uintptr_t status;
+	// Also the futex word the waiting thread parks on
+	atomic<int> status;
 	aggregator_operation* my_next;
+
+	// Hand the operation back to its thread, and wake the thread if it parked
+	void set_status(int s) {
+		call_itt_notify(releasing, &status);
+		// The operation may be gone once the thread sees s; a late wake finds at most
+		// another waiter on the same address, which rechecks its own status
+		if (status.fetch_and_store(s) == agg_parked)
+			futex_wake_all(status);
+	}
 public:
-	enum aggregator_operation_status {agg_waiting = 0, agg_finished};
-	aggregator_operation() : status(agg_waiting), my_next(NULL) {}
+	/*
+	 * agg_handler is set by an aggregator with a maximum batch size instead of handling the
+	 * operation: its thread takes over the rest of the list, which my_next points to.
+	 *
+	 * agg_detached marks an operation no thread waits for; the handler destroys it instead
+	 * of finishing it, and never passes the rest of a list to it.
+	 *
+	 * agg_parked is agg_waiting with the waiting thread asleep on the status word.
+	 */
+	enum aggregator_operation_status {agg_waiting = 0, agg_finished, agg_handler, agg_detached, agg_parked};
+	aggregator_operation() : my_next(NULL) {status.store<relaxed>(agg_waiting);}
 	void start() {call_itt_notify(acquired, &status);}
-	void finish() {itt_store_word_with_release(status, uintptr_t(agg_finished));}
+	void finish() {set_status(agg_finished);}
 	aggregator_operation *next() {return itt_hide_load_word(my_next);}
 	void set_next(aggregator_operation* n) {itt_hide_store_word(my_next,n);}
+	bool detached() const {return status == agg_detached;}
 };
 
 namespace internal {
@@ -37,6 +60,8 @@ namespace internal {
 class basic_operation_base : public aggregator_operation {
 	friend class basic_handler;
 	virtual void apply_body() = 0;
+	// Destroy a detached operation after its body ran
+	virtual void release() {__TBB_ASSERT(false, "only detached operations are released");}
 public:
 	basic_operation_base() : aggregator_operation() {}
 	virtual ~basic_operation_base() {}
@@ -50,6 +75,24 @@ public:
 	basic_operation(const Body& b) : basic_operation_base(), my_body(b) {}
 };
 
+/*
+ * Operation of aggregator::execute_async: owns a copy of the body and is deleted by the handler,
+ * which then counts it off the aggregator's outstanding operations
+ */
+template<typename Body>
+class detached_operation : public basic_operation_base, no_assign {
+	Body my_body;
+	atomic<size_t>& my_outstanding;
+	void apply_body() __TBB_override {my_body();}
+	void release() __TBB_override {
+		atomic<size_t>& outstanding = my_outstanding;
+		delete this;
+		outstanding.fetch_and_decrement();
+	}
+public:
+	detached_operation(const Body& b, atomic<size_t>& outstanding) : basic_operation_base(), my_body(b), my_outstanding(outstanding) {}
+};
+
 class basic_handler {
 public:
 	basic_handler() {};
@@ -65,36 +108,173 @@ public:
 			 * A thread that created the operation is waiting for its status,
 			 * so when this thread is done with the operation, it will release the tag
 			 * and update the status to give control back to the waiting thread.
+			 * Nobody waits for a detached operation; it belongs to this thread and is destroyed.
 			 */
 			basic_operation_base& request = static_cast<basic_operation_base&>(*op_list);
 			op_list = op_list->next();
 			request.start();
 			request.apply_body();
-			request.finish();
+			if (request.detached())
+				request.release();
+			else
+				request.finish();
 		}
 	}
 };
 }
 
+// Batching and latency of an aggregator, see aggregator_ext::statistics()
+struct aggregator_statistics {
+	static const size_t latency_buckets = tbb::internal::latency_histogram::buckets;
+	// Calls of the handler, and how many of them passed the rest of their list on
+	size_t batches;
+	size_t handoffs;
+	// Operations handled, and the most in one call of the handler
+	size_t operations;
+	size_t largest_batch;
+	// Bucket i counts operations whose process() or execute() took [2^i, 2^(i+1)) ns;
+	// the first and last buckets are open ended
+	size_t latency_histogram[latency_buckets];
+};
+
 /*
  * An aggregator for collecting operations coming from multiple sources
  * and executing them executing them serially on a single thread
+ *
+ * By default the handling thread takes the whole mailbox, so under heavy load it may run
+ * an unbounded number of operations before its own call returns. With a max_batch_size
+ * the handler gets at most that many of the oldest operations, and the waiting thread of
+ * the next older one takes over the others after it. Every handling thread then runs at
+ * most max_batch_size operations, its own among them.
+ *
+ * Threads waiting for their operation spin for a while and then park on the status word
+ * of the operation, which the handler sets with finish() or the handoff to the next
+ * handler; only the thread of that operation is woken, as soon as it is set. Threads
+ * waiting for the handler to become free, and flush(), park on a futex_event that is
+ * notified after each batch. On an oversubscribed machine waiters give their CPU to the
+ * handler instead of spinning on it.
+ *
+ * An instrumented aggregator counts batches and times each operation from process() to its
+ * completion. Batch counts are kept by the handling thread only; the latencies cost two
+ * clock reads and an atomic add per operation.
  */
 
 template <typename handler_type>
 class aggregator_ext : tbb::internal::no_copy {
 public:
-	aggregator_ext(const handler_type& h) : handler_busy(0), handle_operations(h) {mailbox = NULL;}
+	aggregator_ext(const handler_type& h, size_t max_batch_size = 0, bool instrumented = false) :
+		handler_busy(0), handle_operations(h), my_operation_spin(min_operation_spin_rounds),
+		my_max_batch_size(max_batch_size), my_instrumented(instrumented) {
+		mailbox = NULL;
+		my_batches = 0;
+		my_handoffs = 0;
+		my_operations = 0;
+		my_largest_batch = 0;
+		my_latencies.init();
+	}
 	void process(aggregator_operation *op) {execute_impl(*op);}
 
+	// 0 if batches are not bounded
+	size_t max_batch_size() const {return my_max_batch_size;}
+
+	// Only the counters of an instrumented aggregator are filled in; approximate while operations run
+	aggregator_statistics statistics() const {
+		aggregator_statistics s;
+		s.batches = my_batches;
+		s.handoffs = my_handoffs;
+		s.operations = my_operations;
+		s.largest_batch = my_largest_batch;
+		my_latencies.copy_to(s.latency_histogram);
+		return s;
+	}
+
 protected:
 	/*
 	 * Place operation in mailbox, then either handle mailbox
 	 * or wait for the operation to be completed by a different thread
 	 */
 	void execute_impl(aggregator_operation& op) {
+		if (my_instrumented) {
+			tick_count start = tick_count::now();
+			enqueue_and_wait(op);
+			my_latencies.record(start);
+		} else {
+			enqueue_and_wait(op);
+		}
+	}
+
+	/*
+	 * Place an operation nobody waits for in the mailbox, and handle the mailbox if it was empty.
+	 * The handler owns op from then on; handle_operations must destroy it (see detached()).
+	 */
+	void execute_detached_impl(aggregator_operation& op) {
+		op.status = aggregator_operation::agg_detached;
+		call_itt_notify(releasing, &(op.status));
+		if (enqueue(op)) {
+			call_itt_notify(acquired,&mailbox);
+			start_handle_operations();
+		}
+	}
+
+	// Return once pred() holds; pred must be made true by handle_operations
+	template<typename Predicate>
+	void wait_for_handler(const Predicate& pred) {my_wakeups.wait(pred);}
+
+private:
+	atomic<aggregator_operation *> mailbox;
+
+	/*
+	 * Controls thread access to handle_operations
+	 * Behaves as boolean flag where 0 = flags, 1 = true;
+	 */
+	uintptr_t handler_busy;
+	handler_type handle_operations;
+
+	// Notified after every batch, for the threads waiting until the handler is free
+	futex_event my_wakeups;
+	/*
+	 * Spin budget of the threads waiting for their operation. It never drops below the
+	 * rounds where atomic_backoff starts to yield: a waiter that parks at once is woken in
+	 * the middle of the next batch, preempts the handler on an oversubscribed machine, and
+	 * the next waiters park in turn. atomic_backoff yields from its sixth round on.
+	 */
+	static const int min_operation_spin_rounds = 8;
+	adaptive_spin my_operation_spin;
+
+	const size_t my_max_batch_size;
+	const bool my_instrumented;
+	// Written by the handling thread only
+	atomic<size_t> my_batches;
+	atomic<size_t> my_handoffs;
+	atomic<size_t> my_operations;
+	atomic<size_t> my_largest_batch;
+	latency_histogram my_latencies;
+
+	// Predicates for futex_event::wait and adaptive_spin
+	class operation_done_t : tbb::internal::no_assign {
+		const aggregator_operation& my_op;
+	public:
+		operation_done_t(const aggregator_operation& op) : my_op(op) {}
+		bool operator()() const {return my_op.status.load<acquire>() != aggregator_operation::agg_waiting;}
+	};
+
+	class handler_free_t : tbb::internal::no_assign {
+		const uintptr_t& my_handler_busy;
+	public:
+		handler_free_t(const uintptr_t& handler_busy) : my_handler_busy(handler_busy) {}
+		bool operator()() const {return __TBB_load_with_acquire(my_handler_busy) == uintptr_t(0);}
+	};
+
+	// Push op to the mailbox; true if it was empty, so that the caller has to handle it
+	bool enqueue(aggregator_operation& op) {
 		aggregator_operation *res;
+		do {
+			op.my_next = res = mailbox;
+		} while (mailbox.compare_and_swap(&op,res) != res);
+		return !res;
+	}
 
+	void enqueue_and_wait(aggregator_operation& op) {
 		/*
 		 * op.status tag is used to cover accesses to this operation.
 		 * This thread has created the operation,
@@ -103,10 +283,7 @@ protected:
 		 */
 
 		call_itt_notify(releasing, &(op.status));
-		do {
-			op.my_next = res = mailbox;
-		} while (mailbox.compare_and_swap(&op,res) != res);
-		if (!res)
+		if (enqueue(op))
 		{
 			/*
 			 * &mailbox tag covers access to the handler_busy flag,
@@ -119,20 +296,34 @@ protected:
 		else
 		{
 			call_itt_notify(prepare, &(op.status));
-			spin_wait_while_eq(op.status, uintptr_t(aggregator_operation::agg_waiting));
-			itt_load_word_with_acquire(op.status);
+			wait_for_operation(op);
+			if (op.status.load<acquire>() == aggregator_operation::agg_handler) {
+				/*
+				 * The previous handler exceeded the maximum batch size and handed over handler_busy
+				 * with the rest of its list. op is the last (oldest) operation of that list and
+				 * my_next points to its head; op is in the batch this thread handles.
+				 */
+				aggregator_operation *pending_operations = op.my_next;
+				op.my_next = NULL;
+				op.status.store<relaxed>(aggregator_operation::agg_waiting);
+				handle_batch(pending_operations);
+				__TBB_ASSERT(op.status == aggregator_operation::agg_finished, NULL);
+			}
 		}
 	}
 
-private:
-	atomic<aggregator_operation *> mailbox;
-
-	/*
-	 * Controls thread access to handle_operations
-	 * Behaves as boolean flag where 0 = flags, 1 = true;
-	 */
-	uintptr_t handler_busy;
-	handler_type handle_operations;
+	// Return once the handler has set the status of op; parks on the status word after spinning
+	void wait_for_operation(aggregator_operation& op) {
+		if (my_operation_spin(operation_done_t(op)))
+			return;
+		int s = op.status.compare_and_swap(aggregator_operation::agg_parked, aggregator_operation::agg_waiting);
+		if (s == aggregator_operation::agg_waiting)
+			s = aggregator_operation::agg_parked;
+		while (s == aggregator_operation::agg_parked) {
+			futex_wait(op.status, aggregator_operation::agg_parked);
+			s = op.status.load<acquire>();
+		}
+	}
 
 	/*
 	 * Trigger the handing of operations when the handler is free
@@ -150,7 +341,7 @@ private:
 		 * handled by the owner of this aggregator.
 		 */
 		call_itt_notify(prepare,&handler_busy);
-		spin_wait_until_eq(handler_busy,uintptr_t(0));
+		my_wakeups.wait(handler_free_t(handler_busy));
 		call_itt_notify(acquired, &handler_busy);
 
 		// acquire fence not necessary here due to causality rule and surrounding atomics
@@ -162,15 +353,72 @@ private:
 		 * set and a new active handler will now process that list is operations
 		 */
 		call_itt_notify(releasing, &mailbox);
-		pending_operations = mailbox.fetch_and_add(NULL);
+		pending_operations = mailbox.fetch_and_store(NULL);
+		handle_batch(pending_operations);
+	}
+
+	/*
+	 * Handle at most my_max_batch_size operations of the list and pass the rest on,
+	 * or release handler_busy if there is no rest
+	 *
+	 * The list is newest first, so the batch is its tail: the oldest operations, including the
+	 * one of the calling thread. The operation just before the batch gets agg_handler, and its
+	 * my_next is pointed back at the head of the list so that its thread can handle the rest.
+	 * Detached operations have no thread to take over; the batch grows past them to the
+	 * next older waiting operation, or to the whole list if there is none.
+	 */
+	void handle_batch(aggregator_operation *pending_operations) {
+		aggregator_operation *next_handler = NULL;
+		if (my_max_batch_size || my_instrumented) {
+			size_t n = 0;
+			for (aggregator_operation *p = pending_operations; p; p = p->my_next) ++n;
+			if (my_max_batch_size && n > my_max_batch_size) {
+				size_t rest = 0;
+				aggregator_operation *p = pending_operations;
+				for (size_t i = 1; i <= n - my_max_batch_size; ++i, p = p->my_next) {
+					if (!p->detached()) {
+						next_handler = p;
+						rest = i;
+					}
+				}
+				if (next_handler) {
+					aggregator_operation *batch = next_handler->my_next;
+					next_handler->my_next = pending_operations;
+					pending_operations = batch;
+					n -= rest;
+				}
+			}
+			if (my_instrumented) {
+				my_batches = my_batches + 1;
+				my_operations = my_operations + n;
+				if (n > my_largest_batch) my_largest_batch = n;
+				if (next_handler) my_handoffs = my_handoffs + 1;
+			}
+		}
 		handle_operations(pending_operations);
-		itt_store_word_with_release(handler_busy,uintptr_t(0));
+		if (next_handler) {
+			// next_handler's thread is now the active handler and releases handler_busy in turn
+			call_itt_notify(releasing, &handler_busy);
+			next_handler->set_status(aggregator_operation::agg_handler);
+		} else {
+			itt_store_word_with_release(handler_busy,uintptr_t(0));
+		}
+		// The stores above must be visible before notify_all() looks for waiters on the handler
+		__TBB_full_memory_fence();
+		my_wakeups.notify_all();
 	}
 };
 
 class aggregator : private aggregator_ext<internal::basic_handler> {
 public:
-	aggregator() : aggregator_ext<internal::basic_handler>(internal::basic_handler()) {}
+	aggregator() : aggregator_ext<internal::basic_handler>(internal::basic_handler()) {my_outstanding = 0;}
+	// See aggregator_ext for max_batch_size and instrumented
+	explicit aggregator(size_t max_batch_size, bool instrumented = false) :
+		aggregator_ext<internal::basic_handler>(internal::basic_handler(), max_batch_size, instrumented) {my_outstanding = 0;}
+	// Waits for the operations submitted with execute_async
+	~aggregator() {flush();}
+	using aggregator_ext<internal::basic_handler>::max_batch_size;
+	using aggregator_ext<internal::basic_handler>::statistics;
 	/*
 	 * The calling thread stores the function object in a basic_operation and
 	 * places the operation in the aggregator's mailbox
@@ -180,12 +428,184 @@ public:
 		internal::basic_operation<Body> op(b);
 		this->execute_impl(op);
 	}
+
+	/*
+	 * As execute(), but for a body whose completion nobody waits for (statistics updates,
+	 * log appends): a copy of b goes into a heap allocated operation, which the handler
+	 * deletes after running it. Returns without waiting unless the mailbox was empty,
+	 * in which case the calling thread becomes the handler as in execute().
+	 */
+	template<typename Body>
+	void execute_async(const Body& b) {
+		internal::detached_operation<Body>* op = new internal::detached_operation<Body>(b, my_outstanding);
+		my_outstanding.fetch_and_increment();
+		this->execute_detached_impl(*op);
+	}
+
+	/*
+	 * Wait until no operation of execute_async is outstanding; afterwards every body submitted
+	 * before the call has run. Concurrent execute_async calls may keep it waiting.
+	 */
+	void flush() {
+		this->wait_for_handler(all_done_t(my_outstanding));
+	}
+
+private:
+	// Operations of execute_async not yet destroyed by the handler
+	atomic<size_t> my_outstanding;
+
+	class all_done_t : tbb::internal::no_assign {
+		const atomic<size_t>& my_count;
+	public:
+		all_done_t(const atomic<size_t>& count) : my_count(count) {}
+		bool operator()() const {return my_count == 0;}
+	};
+};
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+namespace internal {
+
+// Position of T in Types; there is no value for a T that is not in the list
+template <typename T, typename... Types> struct operation_index;
+template <typename T, typename... Types>
+struct operation_index<T, T, Types...> {static const size_t value = 0;};
+template <typename T, typename U, typename... Types>
+struct operation_index<T, U, Types...> {static const size_t value = 1 + operation_index<T, Types...>::value;};
+
+// Operation of a variant_aggregator: the position of its type in the operation list and the caller's object
+class variant_operation : public aggregator_operation {
+public:
+	const size_t kind;
+	void* const data;
+	variant_operation(size_t k, void* d) : aggregator_operation(), kind(k), data(d) {}
+};
+
+/*
+ * Calls handler(op) for each operation of types First, Rest... and finishes it
+ *
+ * apply() picks the type of a single operation by comparing its kind against the positions,
+ * which the compiler turns into a switch; apply_kind() runs a list of operations that all
+ * have the type at position I with no dispatch at all.
+ */
+template <size_t I, typename... Types> struct variant_dispatch;
+
+template <size_t I>
+struct variant_dispatch<I> {
+	template <typename Handler>
+	static void apply(Handler&, variant_operation&) {__TBB_ASSERT(false, "operation kind out of range");}
+	template <typename Handler>
+	static void apply_groups(Handler&, variant_operation**) {}
+};
+
+template <size_t I, typename First, typename... Rest>
+struct variant_dispatch<I, First, Rest...> {
+	template <typename Handler>
+	static void apply(Handler& handler, variant_operation& op) {
+		if (op.kind == I) {
+			op.start();
+			handler(*static_cast<First*>(op.data));
+			op.finish();
+		} else {
+			variant_dispatch<I+1, Rest...>::apply(handler, op);
+		}
+	}
+
+	// Run groups[I], groups[I+1], ... in that order
+	template <typename Handler>
+	static void apply_groups(Handler& handler, variant_operation** groups) {
+		for (variant_operation* op = groups[I]; op;) {
+			variant_operation& request = *op;
+			op = static_cast<variant_operation*>(request.next());
+			request.start();
+			handler(*static_cast<First*>(request.data));
+			request.finish();
+		}
+		variant_dispatch<I+1, Rest...>::apply_groups(handler, groups);
+	}
+};
+
+/*
+ * Handler of a variant_aggregator
+ *
+ * In mailbox order the operations run newest first, as with basic_handler. Grouped by kind,
+ * the batch is first split into one list per operation type, oldest first, and the lists run
+ * in the order of the types: a handler for push, pop and top of a heap sees all pushes of the
+ * batch before the pops, and dispatches once per type instead of once per operation.
+ */
+template <typename Handler, typename... Operations>
+class variant_handler {
+	Handler my_handler;
+	bool my_group_by_kind;
+public:
+	variant_handler(const Handler& h, bool group_by_kind) : my_handler(h), my_group_by_kind(group_by_kind) {}
+	void operator() (aggregator_operation* op_list) {
+		if (my_group_by_kind) {
+			variant_operation* groups[sizeof...(Operations)] = {};
+			while (op_list) {
+				variant_operation& request = static_cast<variant_operation&>(*op_list);
+				op_list = op_list->next();
+				request.set_next(groups[request.kind]);
+				groups[request.kind] = &request;
+			}
+			variant_dispatch<0, Operations...>::apply_groups(my_handler, groups);
+		} else {
+			while (op_list) {
+				variant_operation& request = static_cast<variant_operation&>(*op_list);
+				op_list = op_list->next();
+				variant_dispatch<0, Operations...>::apply(my_handler, request);
+			}
+		}
+	}
 };
 }
 
+/*
+ * An aggregator for a fixed set of operation types
+ *
+ * execute(op) queues a tag for the type of op and a pointer to it, and the handler calls
+ * Handler::operator() for that type, so there is no virtual call and no operation object
+ * per body as with aggregator. Operations are plain structs that carry their arguments
+ * and receive their results, for example:
+ *
+ *     struct push_op {int value;};
+ *     struct pop_op {int result; bool found;};
+ *     struct heap_handler {
+ *         std::priority_queue<int>* heap;
+ *         void operator()(push_op& op) {heap->push(op.value);}
+ *         void operator()(pop_op& op) {...}
+ *     };
+ *     variant_aggregator<heap_handler, push_op, pop_op> agg(heap_handler(&heap), true);
+ *
+ * With group_by_kind, each batch runs its operations grouped by type (see variant_handler).
+ */
+template <typename Handler, typename... Operations>
+class variant_aggregator : private aggregator_ext<internal::variant_handler<Handler, Operations...> > {
+	typedef aggregator_ext<internal::variant_handler<Handler, Operations...> > base_type;
+public:
+	// See aggregator_ext for max_batch_size and instrumented
+	explicit variant_aggregator(const Handler& h = Handler(), bool group_by_kind = false,
+			size_t max_batch_size = 0, bool instrumented = false) :
+		base_type(internal::variant_handler<Handler, Operations...>(h, group_by_kind), max_batch_size, instrumented) {}
+	using base_type::max_batch_size;
+	using base_type::statistics;
+
+	// Op must be one of Operations; returns after the handler has run on op
+	template <typename Op>
+	void execute(Op& op) {
+		internal::variant_operation request(internal::operation_index<Op, Operations...>::value, &op);
+		this->execute_impl(request);
+	}
+};
+#endif /* __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT */
+}
+
 using interface6::aggregator;
 using interface6::aggregator_ext;
 using interface6::aggregator_operation;
+using interface6::aggregator_statistics;
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+using interface6::variant_aggregator;
+#endif
 
 }
 
@@ -0,0 +1,810 @@
+/*
+ * concurrent_block_vector.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_CONCURRENT_BLOCK_VECTOR_H_
+#define INCLUDE_TBB_CONCURRENT_BLOCK_VECTOR_H_
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "atomic.h"
+#include "cache_aligned_allocator.h"
+#include "blocked_range.h"
+#include "tbb_machine.h"
+#include <new>
+#include <cstring>
+#include <iterator>
+
+namespace tbb {
+
+template <typename T, size_t BlockSize = 4096, class A = cache_aligned_allocator<T> >
+class concurrent_block_vector;
+
+namespace internal {
+
+template <typename Container, typename Value>
+class block_vector_iterator;
+
+static void *const block_allocation_failed_flag = reinterpret_cast<void*>(size_t(63));
+
+/*
+ * Customization point for block storage
+ *
+ * Blocks are requested together with their index, so an allocator that places
+ * block b at a fixed location (e.g. a file offset) can specialize this template.
+ * Other allocations of the vector (the chunk table) go through the allocator as usual.
+ */
+template <typename Allocator>
+struct block_storage_traits {
+	static void* allocate_block(Allocator& a, size_t /*block_index*/, size_t n) {
+		return a.allocate(n);
+	}
+	static void deallocate_block(Allocator& a, size_t /*block_index*/, void* p, size_t n) {
+		a.deallocate(static_cast<typename Allocator::pointer>(p), n);
+	}
+};
+
+/*
+ * Base class of concurrent block vector implementation
+ *
+ * Elements live in blocks of a fixed power-of-two size, so the vector never asks
+ * for more than one block of contiguous memory and never leaves more than one
+ * partially used block at its tail.
+ *
+ * The block pointers themselves are kept in a chunked table which grows the same
+ * way concurrent_vector grows its segments: chunk k holds first_chunk_size<<k pointers.
+ * Chunks are never moved once published, so readers can find a block without any lock.
+ */
+class concurrent_block_vector_base : no_copy {
+protected:
+	typedef size_t size_type;
+	typedef size_t block_index_t;
+	typedef atomic<void*> block_pointer;
+
+	enum {
+		first_chunk_log2 = 6,
+		first_chunk_size = 1<<first_chunk_log2,
+		pointers_per_chunk_table = sizeof(block_index_t) * 8 - first_chunk_log2
+	};
+
+	// Requested size of vector
+	atomic<size_type> my_early_size;
+
+	// Table of chunks of block pointers
+	atomic<block_pointer*> my_chunk[pointers_per_chunk_table];
+
+	concurrent_block_vector_base() {
+		my_early_size.store<relaxed>(0);
+		for (size_type k = 0; k < pointers_per_chunk_table; ++k)
+			my_chunk[k].store<relaxed>(NULL);
+	}
+
+	// Index of the chunk holding pointer to block b; offset receives position of the pointer inside the chunk
+	static size_type chunk_index_of(block_index_t b, block_index_t& offset) {
+		block_index_t x = b + first_chunk_size;
+		size_type k = size_type(__TBB_Log2(x)) - first_chunk_log2;
+		offset = x - (block_index_t(first_chunk_size)<<k);
+		return k;
+	}
+	static size_type chunk_size(size_type k) {
+		return size_type(first_chunk_size)<<k;
+	}
+	static block_index_t chunk_base(size_type k) {
+		return (block_index_t(first_chunk_size)<<k) - first_chunk_size;
+	}
+
+	// Pointer slot of block b, or NULL when the chunk holding it was not allocated yet
+	block_pointer* find_block_slot(block_index_t b) const {
+		block_index_t offset;
+		size_type k = chunk_index_of(b, offset);
+		block_pointer* chunk = my_chunk[k].load<acquire>();
+		return chunk ? chunk + offset : NULL;
+	}
+};
+
+// Meet requirements of a random access iterator for STL and a value for a blocked_range
+template <typename Container, typename Value>
+class block_vector_iterator {
+	// Block vector over which we are iterating
+	Container* my_vector;
+
+	// Index into the vector
+	size_t my_index;
+
+	// Cached pointer to the element, reset whenever the iterator crosses a block boundary
+	mutable Value* my_item;
+
+	template <typename C, typename T, typename U>
+	friend bool operator == (const block_vector_iterator<C,T>& i, const block_vector_iterator<C,U>& j);
+
+	template <typename C, typename T, typename U>
+	friend bool operator < (const block_vector_iterator<C,T>& i, const block_vector_iterator<C,U>& j);
+
+	template <typename C, typename T, typename U>
+	friend ptrdiff_t operator - (const block_vector_iterator<C,T>& i, const block_vector_iterator<C,U>& j);
+
+	template <typename C, typename U>
+	friend class internal::block_vector_iterator;
+
+#if !__TBB_TEMPLATE_FRIENDS_BROKEN
+	template <typename T, size_t B, class A>
+	friend class tbb::concurrent_block_vector;
+#else
+public:
+#endif
+
+	block_vector_iterator(const Container& vector, size_t index, void* ptr = 0) :
+		my_vector(const_cast<Container*>(&vector)),
+		my_index(index),
+		my_item(static_cast<Value*>(ptr))
+	{}
+
+public:
+	block_vector_iterator() : my_vector(NULL), my_index(~size_t(0)), my_item(NULL) {}
+
+	block_vector_iterator(const block_vector_iterator<Container,typename Container::value_type>& other) :
+		my_vector(other.my_vector),
+		my_index(other.my_index),
+		my_item(other.my_item)
+	{}
+
+	block_vector_iterator operator+ (ptrdiff_t offset) const {
+		return block_vector_iterator(*my_vector, my_index+offset);
+	}
+
+	block_vector_iterator &operator+=(ptrdiff_t offset) {
+		my_index += offset;
+		my_item = NULL;
+		return *this;
+	}
+
+	block_vector_iterator operator- (ptrdiff_t offset) const {
+		return block_vector_iterator(*my_vector, my_index-offset);
+	}
+
+	block_vector_iterator &operator-=(ptrdiff_t offset) {
+		my_index -= offset;
+		my_item = NULL;
+		return *this;
+	}
+
+	Value& operator*() const {
+		Value* item = my_item;
+		if (!item) {
+			item = my_item = &my_vector->internal_subscript(my_index);
+		}
+		__TBB_ASSERT(item == &my_vector->internal_subscript(my_index), "corrupt cache");
+		return *item;
+	}
+
+	Value& operator[] (ptrdiff_t k) const {
+		return my_vector->internal_subscript(my_index+k);
+	}
+
+	Value* operator-> () const {return &operator*();}
+
+	// Pre increment
+	block_vector_iterator &operator++() {
+		size_t element_index = ++my_index;
+		if (my_item) {
+			if (modulo_power_of_two(element_index, Container::block_size) == 0)
+				my_item = NULL;
+			else
+				++my_item;
+		}
+		return *this;
+	}
+
+	// Pre decrement
+	block_vector_iterator &operator--() {
+		size_t element_index = my_index--;
+		if (my_item) {
+			if (modulo_power_of_two(element_index, Container::block_size) == 0)
+				my_item = NULL;
+			else
+				--my_item;
+		}
+		return *this;
+	}
+
+	block_vector_iterator operator++(int) {
+		block_vector_iterator result = *this;
+		operator++();
+		return result;
+	}
+
+	block_vector_iterator operator--(int) {
+		block_vector_iterator result = *this;
+		operator--();
+		return result;
+	}
+
+	typedef ptrdiff_t difference_type;
+	typedef Value value_type;
+	typedef Value* pointer;
+	typedef Value& reference;
+	typedef std::random_access_iterator_tag iterator_category;
+};
+
+template <typename Container, typename T>
+block_vector_iterator<Container,T> operator+(ptrdiff_t offset, const block_vector_iterator<Container,T>& v) {
+	return v + offset;
+}
+
+template <typename Container, typename T, typename U>
+bool operator==(const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return i.my_index == j.my_index && i.my_vector == j.my_vector;
+}
+
+template <typename Container, typename T, typename U>
+bool operator!=(const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return !(i==j);
+}
+
+template <typename Container, typename T, typename U>
+bool operator < (const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return i.my_index < j.my_index;
+}
+
+template <typename Container, typename T, typename U>
+bool operator > (const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return j < i;
+}
+
+template <typename Container, typename T, typename U>
+bool operator <= (const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return !(j<i);
+}
+
+template <typename Container, typename T, typename U>
+bool operator >= (const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return !(i<j);
+}
+
+template <typename Container, typename T, typename U>
+ptrdiff_t operator - (const block_vector_iterator<Container,T>& i, const block_vector_iterator<Container,U>& j) {
+	return ptrdiff_t(i.my_index) - ptrdiff_t(j.my_index);
+}
+}
+
+/*
+ * Concurrent vector with fixed-size blocks
+ *
+ * Same concurrency guarantees as concurrent_vector: growth, push_back and access to
+ * already constructed elements may run concurrently, elements never move once constructed.
+ * Unlike concurrent_vector, which allocates segments of increasing power-of-two sizes,
+ * storage is added BlockSize elements at a time, so
+ *   - the unused tail capacity is always less than one block,
+ *   - the largest single allocation is BlockSize*sizeof(T) bytes, whatever the size of the vector.
+ * The price is one extra indirection (chunk table -> block table) on random access;
+ * iterators cache the element pointer, so sequential traversal only pays it once per block.
+ */
+template <typename T, size_t BlockSize, class A>
+class concurrent_block_vector : private internal::concurrent_block_vector_base {
+	__TBB_STATIC_ASSERT(BlockSize && !(BlockSize & (BlockSize-1)), "BlockSize must be a power of two");
+
+	template <typename I>
+	class generic_range_type : public blocked_range<I> {
+	public:
+		typedef T value_type;
+		typedef T& reference;
+		typedef const T& const_reference;
+		typedef I iterator;
+		typedef ptrdiff_t difference_type;
+		generic_range_type(I begin_, I end_, size_t grainsize_ = 1) : blocked_range<I>(begin_, end_, grainsize_) {}
+		template <typename U>
+		generic_range_type(const generic_range_type<U>& r) : blocked_range<I>(r.begin(), r.end(), r.grainsize()) {}
+		generic_range_type(generic_range_type& r, split) : blocked_range<I>(r,split()) {}
+	};
+
+	template <typename C, typename U>
+	friend class internal::block_vector_iterator;
+
+public:
+	typedef internal::concurrent_block_vector_base::size_type size_type;
+	typedef typename A::template rebind<T>::other allocator_type;
+
+	typedef T value_type;
+	typedef ptrdiff_t difference_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef T *pointer;
+	typedef const T *const_pointer;
+
+	typedef internal::block_vector_iterator<concurrent_block_vector,T> iterator;
+	typedef internal::block_vector_iterator<concurrent_block_vector,const T> const_iterator;
+
+	typedef std::reverse_iterator<iterator> reverse_iterator;
+	typedef std::reverse_iterator<const_iterator> const_reverse_iterator;
+
+	/*
+	 * Parallel algorithm support
+	 */
+	typedef generic_range_type<iterator> range_type;
+	typedef generic_range_type<const_iterator> const_range_type;
+
+	// Number of elements in every block
+	static const size_type block_size = BlockSize;
+
+	/*
+	 * Constructors & destructors
+	 */
+	explicit concurrent_block_vector(const allocator_type& a = allocator_type()) : my_allocator(a) {}
+
+	concurrent_block_vector(const concurrent_block_vector& vector)
+	    : internal::concurrent_block_vector_base(), my_allocator(vector.my_allocator)
+	{
+		__TBB_TRY {
+			internal_copy(vector);
+		} __TBB_CATCH(...) {
+			clear();
+			internal_free_blocks(0);
+			__TBB_RETHROW();
+		}
+	}
+
+	// If copying an element throws, the vector is left empty
+	concurrent_block_vector& operator=(const concurrent_block_vector& vector) {
+		if (this != &vector)
+		{
+			clear();
+			__TBB_TRY {
+				internal_copy(vector);
+			} __TBB_CATCH(...) {
+				clear();
+				__TBB_RETHROW();
+			}
+		}
+		return *this;
+	}
+
+	~concurrent_block_vector() {
+		clear();
+		internal_free_blocks(0);
+	}
+
+	/*
+	 * Concurrent operations
+	 */
+
+	// Grow by "delta" default constructed elements, returns iterator to the first new element
+	iterator grow_by(size_type delta) {
+		size_type start = my_early_size.fetch_and_add(delta);
+		internal_grow(start, start+delta, &initialize_array, NULL);
+		return iterator(*this, start);
+	}
+
+	// Grow by "delta" elements using copying constructor
+	iterator grow_by(size_type delta, const_reference t) {
+		size_type start = my_early_size.fetch_and_add(delta);
+		internal_grow(start, start+delta, &initialize_array_by, static_cast<const void*>(&t));
+		return iterator(*this, start);
+	}
+
+	iterator push_back(const_reference item) {
+		push_back_helper prolog(*this);
+		new(prolog.internal_push_back_result()) T(item);
+		return prolog.return_iterator_and_dismiss();
+	}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	iterator push_back(T&& item) {
+		push_back_helper prolog(*this);
+		new(prolog.internal_push_back_result()) T(std::move(item));
+		return prolog.return_iterator_and_dismiss();
+	}
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+	template <typename... Args>
+	iterator emplace_back(Args&&... args) {
+		push_back_helper prolog(*this);
+		new(prolog.internal_push_back_result()) T(std::forward<Args>(args)...);
+		return prolog.return_iterator_and_dismiss();
+	}
+#endif
+#endif
+
+	/*
+	 * Get reference to element at given index
+	 *
+	 * This method is thread-safe for concurrent reads,
+	 * while growing the vector, as long as the calling thread has checked that index < size()
+	 */
+	reference operator[](size_type index) {return internal_subscript(index);}
+	const_reference operator[](size_type index) const {return internal_subscript(index);}
+
+	reference at(size_type index) {return internal_subscript_with_exceptions(index);}
+	const_reference at(size_type index) const {return internal_subscript_with_exceptions(index);}
+
+	range_type range(size_t grainsize = 1) {
+		return range_type(begin(), end(), grainsize);
+	}
+
+	const_range_type range(size_t grainsize = 1) const {
+		return const_range_type(begin(), end(), grainsize);
+	}
+
+	/*
+	 * Capacity
+	 */
+
+	// Requested size, may include elements that are still being constructed by other threads
+	size_type size() const {return my_early_size;}
+	bool empty() const {return !my_early_size;}
+
+	// Number of elements in the allocated prefix of blocks
+	size_type capacity() const {
+		block_index_t b = 0;
+		for (block_pointer* slot; (slot = find_block_slot(b)) && slot->load<acquire>() > internal::block_allocation_failed_flag; ++b) {}
+		return b*block_size;
+	}
+
+	size_type max_size() const {return (~size_type(0))/sizeof(T);}
+
+	// Allocate blocks for at least n elements; may run concurrently with growth
+	void reserve(size_type n) {
+		if (n > max_size())
+			internal::throw_exception(internal::eid_reservation_length_error);
+		for (block_index_t b = 0; b*block_size < n; ++b)
+			internal_block(b, /*owner=*/true);
+	}
+
+	// Release the blocks that lie entirely past size(); not thread-safe
+	void shrink_to_fit() {
+		internal_free_blocks((my_early_size + block_size - 1)/block_size);
+	}
+
+	/*
+	 * STL support
+	 */
+	iterator begin() {return iterator(*this,0);}
+	iterator end()   {return iterator(*this,size());}
+	const_iterator begin() const {return const_iterator(*this,0);}
+	const_iterator end()   const {return const_iterator(*this,size());}
+	const_iterator cbegin() const {return const_iterator(*this,0);}
+	const_iterator cend()   const {return const_iterator(*this,size());}
+	reverse_iterator rbegin() {return reverse_iterator(end());}
+	reverse_iterator rend()   {return reverse_iterator(begin());}
+	const_reverse_iterator rbegin() const {return const_reverse_iterator(end());}
+	const_reverse_iterator rend()   const {return const_reverse_iterator(begin());}
+
+	reference front() {
+		__TBB_ASSERT(size() > 0, NULL);
+		return internal_subscript(0);
+	}
+	const_reference front() const {
+		__TBB_ASSERT(size() > 0, NULL);
+		return internal_subscript(0);
+	}
+	reference back() {
+		__TBB_ASSERT(size() > 0, NULL);
+		return internal_subscript(size()-1);
+	}
+	const_reference back() const {
+		__TBB_ASSERT(size() > 0, NULL);
+		return internal_subscript(size()-1);
+	}
+
+	allocator_type get_allocator() const {return my_allocator;}
+
+	void swap(concurrent_block_vector& vector) {
+		using std::swap;
+		if (this != &vector)
+		{
+			tbb::internal::swap<relaxed>(my_early_size, vector.my_early_size);
+			for (size_type k = 0; k < pointers_per_chunk_table; ++k)
+				tbb::internal::swap<relaxed>(my_chunk[k], vector.my_chunk[k]);
+			swap(my_allocator, vector.my_allocator);
+		}
+	}
+
+	// Destroy all elements but keep the blocks for reuse; not thread-safe
+	void clear() {
+		size_type n = my_early_size;
+		for (block_index_t b = 0; b*block_size < n; ++b) {
+			block_pointer* slot = find_block_slot(b);
+			void* array = slot ? slot->load<relaxed>() : NULL;
+			if (array > internal::block_allocation_failed_flag) {
+				size_type count = n - b*block_size;
+				destroy_array(array, count < block_size ? count : block_size);
+			}
+		}
+		my_early_size = 0;
+	}
+
+protected:
+	/*
+	 * Take over n elements that already sit in the blocks, without constructing them.
+	 * Meant for derived containers whose block storage outlives the vector; not thread-safe.
+	 */
+	void internal_adopt(size_type n) {
+		__TBB_ASSERT(my_early_size == 0, NULL);
+		reserve(n);
+		my_early_size = n;
+	}
+
+private:
+	typedef typename A::template rebind<block_pointer>::other chunk_allocator_type;
+	typedef internal::block_storage_traits<allocator_type> block_storage;
+
+	allocator_type my_allocator;
+
+	typedef void (*array_op)(void* begin, const void* src, size_type n);
+
+	T& internal_subscript(size_type index) const;
+	T& internal_subscript_with_exceptions(size_type index) const;
+
+	T* internal_block(block_index_t b, bool owner);
+	block_pointer& internal_block_slot(block_index_t b);
+	void internal_grow(size_type start, size_type finish, array_op init, const void* src);
+	void internal_zero_fill(size_type start, size_type finish);
+	void internal_copy(const concurrent_block_vector& src);
+	void internal_free_blocks(block_index_t first);
+
+	static void initialize_array(void* begin, const void*, size_type n);
+	static void initialize_array_by(void* begin, const void* src, size_type n);
+	static void destroy_array(void* begin, size_type n);
+
+	// Exception-aware helper to construct n elements; zeroes what is left unconstructed on exception
+	class internal_loop_guide : internal::no_copy {
+	public:
+		T* const array;
+		const size_type n;
+		size_type i;
+
+		internal_loop_guide(size_type ntrials, void* ptr) : array(static_cast<T*>(ptr)), n(ntrials), i(0) {}
+
+		void init() {
+			for (; i < n; ++i)
+				new(&array[i]) T();
+		}
+		void init(const void* src) {
+			for (; i < n; ++i)
+				new(&array[i]) T(*static_cast<const T*>(src));
+		}
+		void copy(const void* src) {
+			for (; i < n; ++i)
+				new(&array[i]) T(static_cast<const T*>(src)[i]);
+		}
+
+		~internal_loop_guide() {
+			if (i < n)
+				std::memset(static_cast<void*>(array+i), 0, (n-i)*sizeof(T));
+		}
+	};
+
+	struct push_back_helper : internal::no_copy {
+		concurrent_block_vector& v;
+		size_type k;
+		T* element;
+
+		push_back_helper(concurrent_block_vector& vector) : v(vector), k(v.my_early_size.fetch_and_add(1)), element(NULL) {
+			element = v.internal_block(k/block_size, internal::modulo_power_of_two(k, block_size) == 0) + internal::modulo_power_of_two(k, block_size);
+		}
+
+		T* internal_push_back_result() {return element;}
+		iterator return_iterator_and_dismiss() {
+			T* ptr = element;
+			element = NULL;
+			return iterator(v,k,ptr);
+		}
+
+		~push_back_helper() {
+			if (element)
+				std::memset(static_cast<void*>(element), 0, sizeof(T));
+		}
+	};
+};
+
+template <typename T, size_t BlockSize, class A>
+T& concurrent_block_vector<T,BlockSize,A>::internal_subscript(size_type index) const {
+	__TBB_ASSERT(index < my_early_size, "index out of bounds");
+	block_index_t offset;
+	size_type k = chunk_index_of(index/block_size, offset);
+	// The caller learned about the element via some form of external synchronization
+	block_pointer* chunk = my_chunk[k].load<relaxed>();
+	__TBB_ASSERT(chunk, "index is being allocated");
+	void* array = chunk[offset].load<relaxed>();
+	__TBB_ASSERT(array != internal::block_allocation_failed_flag, "the instance is broken by bad allocation. Use at() instead");
+	__TBB_ASSERT(array, "index is being allocated");
+	return static_cast<T*>(array)[internal::modulo_power_of_two(index, block_size)];
+}
+
+template <typename T, size_t BlockSize, class A>
+T& concurrent_block_vector<T,BlockSize,A>::internal_subscript_with_exceptions(size_type index) const {
+	if (index >= my_early_size)
+		internal::throw_exception(internal::eid_out_of_range);
+	block_pointer* slot = find_block_slot(index/block_size);
+	if (!slot)
+		internal::throw_exception(internal::eid_segment_range_error);
+	void* array = slot->load<acquire>();
+	if (array <= internal::block_allocation_failed_flag)
+		internal::throw_exception(internal::eid_index_range_error);
+	return static_cast<T*>(array)[internal::modulo_power_of_two(index, block_size)];
+}
+
+template <typename T, size_t BlockSize, class A>
+typename concurrent_block_vector<T,BlockSize,A>::block_pointer&
+concurrent_block_vector<T,BlockSize,A>::internal_block_slot(block_index_t b) {
+	block_index_t offset;
+	size_type k = chunk_index_of(b, offset);
+	block_pointer* chunk = my_chunk[k].load<acquire>();
+	if (!chunk) {
+		// Chunks are small, so racing threads simply allocate their own and the loser frees it
+		chunk_allocator_type chunk_allocator(my_allocator);
+		block_pointer* new_chunk = chunk_allocator.allocate(chunk_size(k));
+		std::memset(static_cast<void*>(new_chunk), 0, chunk_size(k)*sizeof(block_pointer));
+		chunk = my_chunk[k].compare_and_swap(new_chunk, NULL);
+		if (chunk)
+			chunk_allocator.deallocate(new_chunk, chunk_size(k));
+		else
+			chunk = new_chunk;
+	}
+	return chunk[offset];
+}
+
+/*
+ * Return block b, allocating it if needed
+ *
+ * The owner is the thread whose grow range includes the first element of the block;
+ * it allocates the block, every other thread waits until the block is published.
+ * Waits therefore only go towards lower indices and cannot form a cycle.
+ */
+template <typename T, size_t BlockSize, class A>
+T* concurrent_block_vector<T,BlockSize,A>::internal_block(block_index_t b, bool owner) {
+	block_pointer& slot = internal_block_slot(b);
+	void* array = slot.load<acquire>();
+	if (!array) {
+		if (owner) {
+			void* new_array = NULL;
+			__TBB_TRY {
+				new_array = block_storage::allocate_block(my_allocator, b, block_size);
+			} __TBB_CATCH(...) {
+				slot.compare_and_swap(internal::block_allocation_failed_flag, NULL);
+				__TBB_RETHROW();
+			}
+			// reserve() may have raced with us and published a block already
+			array = slot.compare_and_swap(new_array, NULL);
+			if (array)
+				block_storage::deallocate_block(my_allocator, b, new_array, block_size);
+			else
+				array = new_array;
+		} else {
+			for (internal::atomic_backoff backoff; !(array = slot.load<acquire>()); backoff.pause()) {}
+		}
+	}
+	if (array == internal::block_allocation_failed_flag)
+		internal::throw_exception(internal::eid_bad_last_alloc);
+	return static_cast<T*>(array);
+}
+
+/*
+ * Every block the range owns is allocated before any element is constructed, so that a
+ * failure cannot leave an owned block unpublished while other threads wait for it: the
+ * blocks after a failed allocation are flagged as failed as well. Elements of the range
+ * that are left unconstructed are zeroed, like the rest of a run by internal_loop_guide,
+ * since my_early_size already counts them.
+ */
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::internal_grow(size_type start, size_type finish, array_op init, const void* src) {
+	block_index_t first_owned = (start + block_size - 1)/block_size, end_owned = (finish + block_size - 1)/block_size;
+	for (block_index_t b = first_owned; b < end_owned; ++b) {
+		__TBB_TRY {
+			internal_block(b, true);
+		} __TBB_CATCH(...) {
+			for (; b < end_owned; ++b) {
+				__TBB_TRY {
+					internal_block_slot(b).compare_and_swap(internal::block_allocation_failed_flag, NULL);
+				} __TBB_CATCH(...) {}
+			}
+			internal_zero_fill(start, finish);
+			__TBB_RETHROW();
+		}
+	}
+	while (start < finish) {
+		block_index_t b = start/block_size;
+		size_type offset = internal::modulo_power_of_two(start, block_size);
+		size_type n = block_size - offset;
+		if (n > finish - start) n = finish - start;
+		__TBB_TRY {
+			T* array = internal_block(b, offset == 0);
+			init(array + offset, src, n);
+		} __TBB_CATCH(...) {
+			internal_zero_fill(start + n, finish);
+			__TBB_RETHROW();
+		}
+		start += n;
+	}
+}
+
+// Zero [start,finish) in the blocks that got allocated; waits for a block owned by another thread
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::internal_zero_fill(size_type start, size_type finish) {
+	while (start < finish) {
+		block_index_t b = start/block_size;
+		size_type offset = internal::modulo_power_of_two(start, block_size);
+		size_type n = block_size - offset;
+		if (n > finish - start) n = finish - start;
+		void* array = NULL;
+		if (offset) {
+			__TBB_TRY {
+				array = internal_block(b, false);
+			} __TBB_CATCH(...) {}
+		} else if (block_pointer* slot = find_block_slot(b)) {
+			array = slot->load<acquire>();
+		}
+		if (array > internal::block_allocation_failed_flag)
+			std::memset(static_cast<void*>(static_cast<T*>(array) + offset), 0, n*sizeof(T));
+		start += n;
+	}
+}
+
+/*
+ * my_early_size counts the elements copied so far, so that after an exception
+ * clear() destroys exactly the constructed ones
+ */
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::internal_copy(const concurrent_block_vector& src) {
+	__TBB_ASSERT(my_early_size == 0, NULL);
+	size_type n = src.size();
+	for (size_type i = 0; i < n; i += block_size) {
+		size_type count = n - i < block_size ? n - i : size_type(block_size);
+		internal_loop_guide loop(count, internal_block(i/block_size, true));
+		__TBB_TRY {
+			loop.copy(&src.internal_subscript(i));
+		} __TBB_CATCH(...) {
+			my_early_size = i + loop.i;
+			__TBB_RETHROW();
+		}
+		my_early_size = i + count;
+	}
+}
+
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::internal_free_blocks(block_index_t first) {
+	chunk_allocator_type chunk_allocator(my_allocator);
+	for (size_type k = 0; k < pointers_per_chunk_table; ++k) {
+		block_pointer* chunk = my_chunk[k].load<relaxed>();
+		if (!chunk) continue;
+		for (size_type j = 0; j < chunk_size(k); ++j) {
+			if (chunk_base(k) + j < first) continue;
+			void* array = chunk[j].load<relaxed>();
+			if (array > internal::block_allocation_failed_flag)
+				block_storage::deallocate_block(my_allocator, chunk_base(k) + j, array, block_size);
+			chunk[j].store<relaxed>(NULL);
+		}
+		if (chunk_base(k) >= first) {
+			my_chunk[k].store<relaxed>(NULL);
+			chunk_allocator.deallocate(chunk, chunk_size(k));
+		}
+	}
+}
+
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::initialize_array(void* begin, const void*, size_type n) {
+	internal_loop_guide loop(n, begin);
+	loop.init();
+}
+
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::initialize_array_by(void* begin, const void* src, size_type n) {
+	internal_loop_guide loop(n, begin);
+	loop.init(src);
+}
+
+template <typename T, size_t BlockSize, class A>
+void concurrent_block_vector<T,BlockSize,A>::destroy_array(void* begin, size_type n) {
+	T* array = static_cast<T*>(begin);
+	for (size_type j = n; j > 0; --j)
+		array[j-1].~T();
+}
+
+template <typename T, size_t BlockSize, class A>
+inline void swap(concurrent_block_vector<T,BlockSize,A>& a, concurrent_block_vector<T,BlockSize,A>& b) {
+	a.swap(b);
+}
+
+}
+
+#endif /* INCLUDE_TBB_CONCURRENT_BLOCK_VECTOR_H_ */
@@ -0,0 +1,282 @@
+/*
+ * concurrent_log.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_CONCURRENT_LOG_H_
+#define INCLUDE_TBB_CONCURRENT_LOG_H_
+
+#if _WIN32||_WIN64
+#error concurrent_log.h requires POSIX mmap
+#endif
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "cache_aligned_allocator.h"
+#include "spin_mutex.h"
+#include "concurrent_block_vector.h"
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string>
+
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+#include <type_traits>
+#endif
+
+namespace tbb {
+
+template <typename T, size_t BlockSize = 4096>
+class concurrent_log;
+
+namespace internal {
+
+/*
+ * File behind a concurrent_log
+ *
+ * Layout: one page of header, then block b at offset page_size + b*block_bytes.
+ * Element i therefore always lives at the same file offset, which is what
+ * lets a restarted process map the blocks back without copying.
+ */
+class log_file : no_copy {
+public:
+	struct header {
+		uint64_t magic;
+		uint64_t element_size;
+		uint64_t block_size;
+		uint64_t size;      // number of records covered by the last sync()
+	};
+	static const uint64_t log_magic = 0x31474f4c4242544dULL;
+
+	log_file(const char* path, size_t element_size, size_t block_size) :
+		my_fd(-1), my_header(NULL), my_block_bytes(element_size*block_size)
+	{
+		my_page_size = size_t(sysconf(_SC_PAGESIZE));
+		if (my_block_bytes % my_page_size)
+			handle_perror(EINVAL, "concurrent_log: BlockSize*sizeof(T) must be a multiple of the page size");
+		my_fd = ::open(path, O_RDWR|O_CREAT, 0644);
+		if (my_fd < 0)
+			handle_perror(errno, "concurrent_log: open");
+		__TBB_TRY {
+			struct stat st;
+			if (fstat(my_fd, &st))
+				handle_perror(errno, "concurrent_log: fstat");
+			my_file_size = size_t(st.st_size);
+			bool fresh = my_file_size == 0;
+			extend(my_page_size);
+			void* h = mmap(NULL, my_page_size, PROT_READ|PROT_WRITE, MAP_SHARED, my_fd, 0);
+			if (h == MAP_FAILED)
+				handle_perror(errno, "concurrent_log: mmap");
+			my_header = static_cast<header*>(h);
+			if (fresh) {
+				my_header->magic = log_magic;
+				my_header->element_size = element_size;
+				my_header->block_size = block_size;
+				my_header->size = 0;
+			} else if (my_header->magic != log_magic || my_header->element_size != element_size
+			           || my_header->block_size != block_size) {
+				handle_perror(EINVAL, "concurrent_log: file was written with a different record layout");
+			}
+		} __TBB_CATCH(...) {
+			close();
+			__TBB_RETHROW();
+		}
+	}
+
+	~log_file() {close();}
+
+	// Map block b, growing the file when the block lies past its end
+	void* map_block(size_t b) {
+		off_t offset = off_t(my_page_size + b*my_block_bytes);
+		extend(size_t(offset) + my_block_bytes);
+		void* p = mmap(NULL, my_block_bytes, PROT_READ|PROT_WRITE, MAP_SHARED, my_fd, offset);
+		if (p == MAP_FAILED)
+			throw_exception(eid_bad_alloc);
+		return p;
+	}
+
+	void unmap_block(void* p) {
+		munmap(p, my_block_bytes);
+	}
+
+	// Flush the given block to disk
+	void sync_block(void* p) {
+		if (msync(p, my_block_bytes, MS_SYNC))
+			handle_perror(errno, "concurrent_log: msync");
+	}
+
+	// Persist the record count; call after the blocks holding the records were synced
+	void sync_size(size_t n) {
+		my_header->size = n;
+		if (msync(my_header, my_page_size, MS_SYNC))
+			handle_perror(errno, "concurrent_log: msync");
+	}
+
+	size_t persisted_size() const {return size_t(my_header->size);}
+
+private:
+	int my_fd;
+	header* my_header;
+	size_t my_page_size;
+	size_t my_block_bytes;
+	// Only ever grows; blocks are mapped concurrently, so ftruncate is serialized
+	size_t my_file_size;
+	spin_mutex my_extend_mutex;
+
+	void extend(size_t n) {
+		spin_mutex::scoped_lock lock(my_extend_mutex);
+		if (n <= my_file_size) return;
+		if (ftruncate(my_fd, off_t(n)))
+			throw_exception(eid_bad_alloc);
+		my_file_size = n;
+	}
+
+	void close() {
+		if (my_header) munmap(my_header, my_page_size);
+		if (my_fd >= 0) ::close(my_fd);
+		my_header = NULL;
+		my_fd = -1;
+	}
+};
+
+/*
+ * Allocator of a concurrent_log
+ *
+ * Blocks are mapped from the file through block_storage_traits, everything else
+ * (the chunk table of the vector) comes from the cache aligned heap.
+ */
+template <typename T>
+class log_block_allocator {
+public:
+	typedef typename internal::allocator_type<T>::value_type value_type;
+	typedef value_type* pointer;
+	typedef const value_type* const_pointer;
+	typedef value_type& reference;
+	typedef const value_type& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	template <typename U> struct rebind {
+		typedef log_block_allocator<U> other;
+	};
+
+	explicit log_block_allocator(log_file* file) throw() : my_file(file) {}
+	template <typename U>
+	log_block_allocator(const log_block_allocator<U>& a) throw() : my_file(a.my_file) {}
+
+	pointer allocate(size_type n, const void* hint = 0) {
+		return cache_aligned_allocator<T>().allocate(n, hint);
+	}
+	void deallocate(pointer p, size_type n) {
+		cache_aligned_allocator<T>().deallocate(p, n);
+	}
+	size_type max_size() const throw() {
+		return cache_aligned_allocator<T>().max_size();
+	}
+
+	log_file* file() const {return my_file;}
+
+	template <typename U> friend class log_block_allocator;
+	template <typename U>
+	bool operator==(const log_block_allocator<U>& a) const {return my_file == a.my_file;}
+	template <typename U>
+	bool operator!=(const log_block_allocator<U>& a) const {return my_file != a.my_file;}
+
+private:
+	log_file* my_file;
+};
+
+template <typename T>
+struct block_storage_traits<log_block_allocator<T> > {
+	static void* allocate_block(log_block_allocator<T>& a, size_t block_index, size_t) {
+		return a.file()->map_block(block_index);
+	}
+	static void deallocate_block(log_block_allocator<T>& a, size_t, void* p, size_t) {
+		a.file()->unmap_block(p);
+	}
+};
+
+// Base-from-member: the file must be open before the vector is constructed and closed after it
+class log_file_holder {
+protected:
+	log_file my_file;
+	log_file_holder(const char* path, size_t element_size, size_t block_size) :
+		my_file(path, element_size, block_size) {}
+};
+
+}
+
+/*
+ * Persistent append-only log
+ *
+ * A concurrent_block_vector whose blocks are shared mappings of a file, so records
+ * written with push_back/grow_by/emplace_back land in the page cache without any copy.
+ * sync() flushes the blocks and records the size in the file header; opening the
+ * same file again maps the blocks back and the log starts with the synced records.
+ *
+ * T must be trivially copyable: records are reused across processes as raw bytes and
+ * are never destroyed. BlockSize*sizeof(T) must be a multiple of the page size.
+ */
+template <typename T, size_t BlockSize>
+class concurrent_log : private internal::log_file_holder,
+	public concurrent_block_vector<T, BlockSize, internal::log_block_allocator<T> >
+{
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+	__TBB_STATIC_ASSERT(std::is_trivially_copyable<T>::value, "concurrent_log requires a trivially copyable record type");
+#endif
+	typedef concurrent_block_vector<T, BlockSize, internal::log_block_allocator<T> > vector_type;
+
+public:
+	typedef typename vector_type::size_type size_type;
+
+	// Open or create the log at path; records covered by the last sync() are available again
+	explicit concurrent_log(const char* path) :
+		internal::log_file_holder(path, sizeof(T), BlockSize),
+		vector_type(internal::log_block_allocator<T>(&my_file))
+	{
+		this->internal_adopt(my_file.persisted_size());
+	}
+
+	explicit concurrent_log(const std::string& path) :
+		internal::log_file_holder(path.c_str(), sizeof(T), BlockSize),
+		vector_type(internal::log_block_allocator<T>(&my_file))
+	{
+		this->internal_adopt(my_file.persisted_size());
+	}
+
+	// The file is synced, but records appended after the last sync() are only as durable as the page cache
+	~concurrent_log() {
+		__TBB_TRY {
+			sync();
+		} __TBB_CATCH(...) {}
+	}
+
+	/*
+	 * Flush the records to disk and persist their count
+	 *
+	 * Not safe against concurrent growth: records whose construction has not
+	 * finished would be persisted half-written.
+	 */
+	void sync() {
+		size_type n = this->size();
+		for (size_type i = 0; i < n; i += BlockSize)
+			my_file.sync_block(&(*this)[i]);
+		my_file.sync_size(n);
+	}
+
+	// Number of records persisted by the last sync()
+	size_type synced_size() const {return my_file.persisted_size();}
+
+private:
+	// Two logs over the same mappings would unmap each other's blocks
+	concurrent_log(const concurrent_log&);
+	concurrent_log& operator=(const concurrent_log&);
+	void swap(concurrent_log&);
+};
+
+}
+
+#endif /* INCLUDE_TBB_CONCURRENT_LOG_H_ */
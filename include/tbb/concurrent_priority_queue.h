@@ -0,0 +1,398 @@
+/*
+ * concurrent_priority_queue.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_CONCURRENT_PRIORITY_QUEUE_H_
+#define INCLUDE_TBB_CONCURRENT_PRIORITY_QUEUE_H_
+
+#if !TBB_PREVIEW_AGGREGATOR
+#error Set TBB_PREVIEW_AGGREGATOR before including concurrent_priority_queue.h, the strict queue is built on the aggregator
+#endif
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "tbb_thread.h"
+#include "atomic.h"
+#include "spin_mutex.h"
+#include "aggregator.h"
+#include "cache_aligned_allocator.h"
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <new>
+
+namespace tbb {
+
+namespace internal {
+
+// Request to the handler of a concurrent_priority_queue
+template <typename T>
+class cpq_operation : public aggregator_operation {
+public:
+	enum operation_type {push_op, push_rvalue_op, pop_op};
+	const operation_type type;
+	T* const elem;
+	// Set by the handler: the push was stored, or the pop found an item
+	bool success;
+	cpq_operation(operation_type t, T* e) : type(t), elem(e), success(false) {}
+};
+
+// Per thread xorshift state for picking sub-heaps of concurrent_relaxed_priority_queue
+inline unsigned relaxed_pq_random() {
+#if __TBB_CPP11_PRESENT
+	static thread_local unsigned state = 0;
+	if (!state)
+		state = unsigned(uintptr_t(&state) >> 4)*2654435761u | 1;
+#else
+	static atomic<unsigned> seed;
+	unsigned state = (seed.fetch_and_add(1) + 1)*2654435761u | 1;
+#endif
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return state;
+}
+
+}
+
+/*
+ * Concurrent priority queue with strict ordering
+ *
+ * try_pop() returns the highest priority item, i.e. the largest one under Compare.
+ * All operations go through an aggregator: one thread at a time applies the whole
+ * batch of pending pushes and pops to a binary heap, while the others wait for their
+ * operation to be finished. Pushes of a batch are appended first and only sifted
+ * into the heap at the end; a pop that finds the last pushed item ahead of the heap
+ * top takes it directly. Contention on the heap is gone, but every operation is
+ * serialized, which makes this the choice for exact order at moderate thread counts.
+ * See concurrent_relaxed_priority_queue for scalable approximate ordering.
+ */
+template <typename T, typename Compare = std::less<T>, typename A = cache_aligned_allocator<T> >
+class concurrent_priority_queue : internal::no_copy {
+	typedef internal::cpq_operation<T> operation;
+
+	class handler {
+		concurrent_priority_queue* my_queue;
+	public:
+		handler(concurrent_priority_queue* q) : my_queue(q) {}
+		void operator()(aggregator_operation* op_list) const {my_queue->handle_operations(op_list);}
+	};
+
+	aggregator_ext<handler> my_aggregator;
+	// Number of items after the last batch; read without going through the aggregator
+	atomic<size_t> my_size;
+	char pad[internal::NFS_MaxLineSize - sizeof(atomic<size_t>)];
+	Compare my_compare;
+	// my_data[0, my_mark) is a heap, the rest was pushed in the current batch
+	size_t my_mark;
+	std::vector<T, A> my_data;
+
+	void handle_operations(aggregator_operation* op_list) {
+		operation* pop_list = NULL;
+		// Pushes, and pops that the items of this batch can serve
+		while (op_list) {
+			operation* op = static_cast<operation*>(op_list);
+			op_list = op_list->next();
+			op->start();
+			if (op->type == operation::pop_op) {
+				if (my_mark < my_data.size() && my_compare(my_data[0], my_data.back())) {
+					*op->elem = tbb::internal::move(my_data.back());
+					my_data.pop_back();
+					op->success = true;
+					op->finish();
+				} else {
+					op->set_next(pop_list);
+					pop_list = op;
+				}
+				continue;
+			}
+			__TBB_TRY {
+				if (op->type == operation::push_op)
+					my_data.push_back(*op->elem);
+				else
+					my_data.push_back(tbb::internal::move(*op->elem));
+				op->success = true;
+			} __TBB_CATCH(...) {
+				op->success = false;
+			}
+			op->finish();
+		}
+		// The remaining pops take the heap top
+		while (pop_list) {
+			operation* op = pop_list;
+			pop_list = static_cast<operation*>(pop_list->next());
+			if (my_data.empty()) {
+				op->success = false;
+			} else {
+				if (my_mark < my_data.size())
+					heapify();
+				*op->elem = tbb::internal::move(my_data[0]);
+				reheap();
+				op->success = true;
+			}
+			op->finish();
+		}
+		if (my_mark < my_data.size())
+			heapify();
+		my_size = my_data.size();
+	}
+
+	// Sift the items after my_mark into the heap
+	void heapify() {
+		if (!my_mark && !my_data.empty())
+			my_mark = 1;
+		for (; my_mark < my_data.size(); ++my_mark) {
+			size_t position = my_mark;
+			T item = tbb::internal::move(my_data[position]);
+			while (position) {
+				size_t parent = (position - 1) >> 1;
+				if (!my_compare(my_data[parent], item))
+					break;
+				my_data[position] = tbb::internal::move(my_data[parent]);
+				position = parent;
+			}
+			my_data[position] = tbb::internal::move(item);
+		}
+	}
+
+	// Fill the hole left at the top by the last item and shrink the heap by one
+	void reheap() {
+		size_t position = 0, child = 1;
+		const size_t last = my_data.size() - 1;
+		while (child < my_mark && child < last) {
+			size_t target = child;
+			if (child + 1 < my_mark && child + 1 < last && my_compare(my_data[child], my_data[child + 1]))
+				++target;
+			if (my_compare(my_data[target], my_data[last]))
+				break;
+			my_data[position] = tbb::internal::move(my_data[target]);
+			position = target;
+			child = 2*position + 1;
+		}
+		if (position != last)
+			my_data[position] = tbb::internal::move(my_data[last]);
+		my_data.pop_back();
+		if (my_mark > my_data.size())
+			my_mark = my_data.size();
+	}
+
+	void execute(operation& op) {
+		my_aggregator.process(&op);
+		if (!op.success && op.type != operation::pop_op)
+			internal::throw_exception(internal::eid_bad_alloc);
+	}
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_priority_queue(const Compare& compare = Compare(), const allocator_type& a = allocator_type()) :
+		my_aggregator(handler(this)), my_compare(compare), my_mark(0), my_data(a) {
+		my_size = 0;
+	}
+
+	void push(const T& item) {
+		operation op(operation::push_op, const_cast<T*>(&item));
+		execute(op);
+	}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& item) {
+		operation op(operation::push_rvalue_op, &item);
+		execute(op);
+	}
+#endif
+
+	// Move the highest priority item into result; false if the queue was empty
+	bool try_pop(T& result) {
+		operation op(operation::pop_op, &result);
+		execute(op);
+		return op.success;
+	}
+
+	// Number of items as of the last batch of operations
+	size_type size() const {return my_size;}
+
+	bool empty() const {return size() == 0;}
+
+	// Remove all items; not thread-safe
+	void clear() {
+		my_data.clear();
+		my_mark = 0;
+		my_size = 0;
+	}
+
+	allocator_type get_allocator() const {return my_data.get_allocator();}
+};
+
+/*
+ * Concurrent priority queue with relaxed ordering (MultiQueue)
+ *
+ * The items are spread over k sequential heaps, each behind its own spin_mutex.
+ * A push goes to a random heap; a pop looks at the tops of two random heaps and
+ * takes the better one. A pop thus returns one of the O(k) best items instead of
+ * the best, which suits schedulers and dispatchers that only need the order to
+ * hold approximately, and in exchange no lock is shared by all threads.
+ * Locks are only tried, so a busy heap is skipped instead of waited for.
+ *
+ * try_pop() only reports an empty queue after finding every heap empty.
+ */
+template <typename T, typename Compare = std::less<T>, typename A = cache_aligned_allocator<T> >
+class concurrent_relaxed_priority_queue : internal::no_copy {
+	struct sub_heap {
+		spin_mutex my_mutex;
+		// Number of items, readable without the lock
+		atomic<size_t> my_size;
+		std::vector<T, A> my_data;
+		sub_heap(const A& a) : my_data(a) {my_size = 0;}
+	};
+	typedef internal::padded<sub_heap> padded_heap;
+	typedef typename A::template rebind<padded_heap>::other heap_allocator_type;
+
+	// Random tries before push falls back to waiting for a lock, or pop to scanning all heaps
+	static const int n_tries = 4;
+
+	const size_t my_n_heaps;
+	padded_heap* my_heaps;
+	Compare my_compare;
+	heap_allocator_type my_allocator;
+
+	sub_heap& random_heap() {return my_heaps[internal::relaxed_pq_random() % my_n_heaps];}
+
+	// Lock a sub-heap for a push: random ones are tried first, the last pick is waited for
+	sub_heap& lock_for_push(spin_mutex::scoped_lock& lock) {
+		for (int i = 0; i < n_tries; ++i) {
+			sub_heap& h = random_heap();
+			if (lock.try_acquire(h.my_mutex))
+				return h;
+		}
+		sub_heap& h = random_heap();
+		lock.acquire(h.my_mutex);
+		return h;
+	}
+
+	// Sift the item appended to a locked sub-heap into place
+	void push_back_locked(sub_heap& h) {
+		std::push_heap(h.my_data.begin(), h.my_data.end(), my_compare);
+		h.my_size = h.my_data.size();
+	}
+
+	void pop_locked(sub_heap& h, T& result) {
+		std::pop_heap(h.my_data.begin(), h.my_data.end(), my_compare);
+		result = tbb::internal::move(h.my_data.back());
+		h.my_data.pop_back();
+		h.my_size = h.my_data.size();
+	}
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	// n_heaps sub-heaps; zero picks two per hardware thread
+	explicit concurrent_relaxed_priority_queue(size_type n_heaps = 0, const Compare& compare = Compare(),
+			const allocator_type& a = allocator_type()) :
+		my_n_heaps(n_heaps ? n_heaps : 2*(tbb_thread::hardware_concurrency() ? tbb_thread::hardware_concurrency() : 1)),
+		my_heaps(NULL), my_compare(compare), my_allocator(a) {
+		my_heaps = my_allocator.allocate(my_n_heaps);
+		size_t i = 0;
+		__TBB_TRY {
+			for (; i < my_n_heaps; ++i)
+				new(static_cast<void*>(&my_heaps[i])) sub_heap(a);
+		} __TBB_CATCH(...) {
+			while (i)
+				my_heaps[--i].~padded_heap();
+			my_allocator.deallocate(my_heaps, my_n_heaps);
+			__TBB_RETHROW();
+		}
+	}
+
+	~concurrent_relaxed_priority_queue() {
+		for (size_t i = 0; i < my_n_heaps; ++i)
+			my_heaps[i].~padded_heap();
+		my_allocator.deallocate(my_heaps, my_n_heaps);
+	}
+
+	void push(const T& item) {
+		spin_mutex::scoped_lock lock;
+		sub_heap& h = lock_for_push(lock);
+		h.my_data.push_back(item);
+		push_back_locked(h);
+	}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& item) {
+		spin_mutex::scoped_lock lock;
+		sub_heap& h = lock_for_push(lock);
+		h.my_data.push_back(std::move(item));
+		push_back_locked(h);
+	}
+#endif
+
+	// Move one of the highest priority items into result; false if all sub-heaps were empty
+	bool try_pop(T& result) {
+		for (int i = 0; i < n_tries; ++i) {
+			sub_heap& a = random_heap();
+			sub_heap& b = random_heap();
+			spin_mutex::scoped_lock lock_a, lock_b;
+			sub_heap* best = NULL;
+			if (a.my_size && lock_a.try_acquire(a.my_mutex) && !a.my_data.empty())
+				best = &a;
+			if (&b != &a && b.my_size && lock_b.try_acquire(b.my_mutex) && !b.my_data.empty()
+					&& (!best || my_compare(best->my_data.front(), b.my_data.front())))
+				best = &b;
+			if (best) {
+				pop_locked(*best, result);
+				return true;
+			}
+		}
+		// Few items or much contention: visit every heap once
+		size_t start = internal::relaxed_pq_random() % my_n_heaps;
+		for (size_t i = 0; i < my_n_heaps; ++i) {
+			sub_heap& h = my_heaps[(start + i) % my_n_heaps];
+			if (!h.my_size)
+				continue;
+			spin_mutex::scoped_lock lock(h.my_mutex);
+			if (!h.my_data.empty()) {
+				pop_locked(h, result);
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Number of items; approximate while other threads push or pop
+	size_type size() const {
+		size_t result = 0;
+		for (size_t i = 0; i < my_n_heaps; ++i)
+			result += my_heaps[i].my_size;
+		return result;
+	}
+
+	bool empty() const {return size() == 0;}
+
+	// Remove all items; not thread-safe
+	void clear() {
+		for (size_t i = 0; i < my_n_heaps; ++i) {
+			my_heaps[i].my_data.clear();
+			my_heaps[i].my_size = 0;
+		}
+	}
+
+	size_type n_heaps() const {return my_n_heaps;}
+
+	allocator_type get_allocator() const {return allocator_type(my_allocator);}
+};
+
+}
+
+#endif /* INCLUDE_TBB_CONCURRENT_PRIORITY_QUEUE_H_ */
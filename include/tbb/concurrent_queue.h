@@ -0,0 +1,523 @@
+/*
+ * concurrent_queue.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_CONCURRENT_QUEUE_H_
+#define INCLUDE_TBB_CONCURRENT_QUEUE_H_
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "cache_aligned_allocator.h"
+#include "internal/_concurrent_queue_impl.h"
+#include "internal/_concurrent_lcrq_impl.h"
+#include <new>
+
+namespace tbb {
+
+namespace strict_ppl {
+
+/*
+ * Unbounded concurrent FIFO queue
+ *
+ * Multiple threads may push and pop concurrently. There is no blocking pop,
+ * use concurrent_bounded_queue for producer/consumer hand-off.
+ *
+ * Policy selects the algorithm: queue_mpmc (the default) takes any number of
+ * producers and consumers, queue_mpsc and queue_spsc are faster specializations
+ * for a single consumer thread, and a single producer thread as well. queue_lcrq
+ * is a lock-free alternative to queue_mpmc where the processor has a 16 byte CAS.
+ *
+ * Instrumentation selects what statistics() reports: queue_plain (the default)
+ * costs nothing, queue_instrumented also tracks the high-water mark and how long
+ * items stay in the queue. It is only available with queue_mpmc.
+ */
+template <typename T, typename A = cache_aligned_allocator<T>, typename Policy = queue_mpmc, typename Instrumentation = queue_plain>
+class concurrent_queue : public internal::queue_allocator_base<internal::concurrent_queue_base_v3<T>, T, A> {
+	typedef internal::queue_allocator_base<internal::concurrent_queue_base_v3<T>, T, A> base_type;
+	__TBB_STATIC_ASSERT((tbb::internal::is_same_type<Policy, queue_mpmc>::value), "unsupported queue policy; only queue_mpmc can be queue_instrumented");
+	static const bool instrumented = tbb::internal::is_same_type<Instrumentation, queue_instrumented>::value;
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_queue(const allocator_type& a = allocator_type()) :
+		base_type(size_type(0), size_type(0), instrumented, a) {}
+
+	/*
+	 * Queue spread over n_queue micro-queues with pages of items_per_page items
+	 *
+	 * More micro-queues let more threads push and pop without meeting on the same
+	 * counters, at the cost of a larger footprint per queue. Both numbers are rounded
+	 * up to powers of two, n_queue to at least 2 and items_per_page to at most the bits
+	 * of a pointer; zero keeps the default (8 micro-queues, pages of about 256 bytes).
+	 */
+	concurrent_queue(size_type n_queue, size_type items_per_page, const allocator_type& a = allocator_type()) :
+		base_type(n_queue, items_per_page, instrumented, a) {}
+
+	// Destroy the remaining items; not thread-safe
+	~concurrent_queue() {
+		clear();
+		this->internal_finish_clear();
+	}
+
+	// Enqueue a copy of source at the tail of the queue
+	void push(const T& source) {this->internal_push(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& source) {this->internal_push(&source, base_type::move_construct_item);}
+#endif
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+	// Enqueue an item constructed in place from args
+	template <typename... Args>
+	void emplace(Args&&... args) {
+		internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		this->internal_push(&emplacer, &internal::item_emplacer<T, Args...>::construct_item);
+	}
+#endif
+
+	// Move the head item into result if the queue is not empty; returns true if an item was popped
+	bool try_pop(T& result) {return this->internal_try_pop(&result);}
+
+	/*
+	 * Move construct the head item in storage if the queue is not empty; returns true if an item was popped
+	 *
+	 * storage is uninitialized memory for a T, a popped item is owned by the caller.
+	 * The item is moved once instead of assigned to a constructed T, and T needs no
+	 * default constructor.
+	 */
+	bool try_pop_into(T* storage) {return this->internal_try_pop(storage, internal::move_construct_popped_item<T>);}
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+	// The head item, or an empty optional if the queue is empty
+	std::optional<T> try_pop() {
+		std::optional<T> result;
+		this->internal_try_pop(&result, internal::emplace_popped_item<T>);
+		return result;
+	}
+#endif
+
+	/*
+	 * Enqueue copies of items[0..n) as one contiguous run
+	 *
+	 * The tickets are reserved with one atomic add and every internal sub-queue takes
+	 * its share in one turn, so the per item cost is the copy and a page slot.
+	 */
+	void push_n(const T* items, size_type n) {this->internal_push_n(items, n, base_type::copy_construct_item);}
+
+	// Move up to n head items into destination[0..); returns the number of items popped
+	size_type try_pop_n(T* destination, size_type n) {return this->internal_try_pop_n(destination, n);}
+
+	// Number of items; not reliable while the queue is modified concurrently
+	size_type unsafe_size() const {return this->internal_size();}
+
+	bool empty() const {return this->internal_empty();}
+
+	/*
+	 * Occupancy and latency counters
+	 *
+	 * The size and invalid entries are always reported, the high-water mark and the
+	 * latency histogram stay zero unless the queue is queue_instrumented. Counters are
+	 * read one at a time, so a snapshot taken during operations is only approximate.
+	 */
+	queue_statistics statistics() const {
+		queue_statistics s;
+		this->internal_statistics(s);
+		return s;
+	}
+
+	// Pop all items; not thread-safe
+	void clear() {
+		while (!empty()) this->internal_try_pop(NULL, NULL);
+	}
+
+	allocator_type get_allocator() const {return this->my_allocator;}
+};
+
+/*
+ * Single producer, single consumer queue
+ *
+ * push() must only be called from one thread and try_pop() from one (other) thread
+ * at a time. Both are wait-free and use no read-modify-write instructions unless
+ * they cross a page.
+ */
+template <typename T, typename A>
+class concurrent_queue<T, A, queue_spsc> : public internal::queue_allocator_base<internal::spsc_queue_base<T>, T, A> {
+	typedef internal::queue_allocator_base<internal::spsc_queue_base<T>, T, A> base_type;
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_queue(const allocator_type& a = allocator_type()) : base_type(a) {}
+
+	// Destroy the remaining items; not thread-safe
+	~concurrent_queue() {
+		clear();
+		this->internal_finish_clear();
+	}
+
+	// Producer thread only
+	void push(const T& source) {this->internal_push(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& source) {this->internal_push(&source, base_type::move_construct_item);}
+#endif
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+	// Producer thread only
+	template <typename... Args>
+	void emplace(Args&&... args) {
+		internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		this->internal_push(&emplacer, &internal::item_emplacer<T, Args...>::construct_item);
+	}
+#endif
+
+	// Consumer thread only
+	bool try_pop(T& result) {return this->internal_try_pop(&result);}
+
+	// Move construct the head item in uninitialized storage; consumer thread only
+	bool try_pop_into(T* storage) {return this->internal_try_pop(storage, internal::move_construct_popped_item<T>);}
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+	// Consumer thread only
+	std::optional<T> try_pop() {
+		std::optional<T> result;
+		this->internal_try_pop(&result, internal::emplace_popped_item<T>);
+		return result;
+	}
+#endif
+
+	size_type unsafe_size() const {return this->internal_size();}
+
+	bool empty() const {return this->internal_empty();}
+
+	// Pop all items; not thread-safe
+	void clear() {
+		while (this->internal_try_pop(NULL, NULL)) {}
+	}
+
+	allocator_type get_allocator() const {return this->my_allocator;}
+};
+
+/*
+ * Multiple producer, single consumer queue
+ *
+ * push() and push_n() may be called from any number of threads; try_pop() and empty()
+ * must only be called from one thread at a time. A push takes its ticket with one
+ * fetch_and_add, constructs the item in the ticket's slot of a page and publishes the
+ * slot by setting its bit in the page mask. Only the producer that gets the first slot
+ * of a page allocates it, or takes a drained page from the pool; a push_n of a whole
+ * range costs one ticket and one mask update per page.
+ *
+ * The consumer takes items in ticket order and stops at the earliest unpublished slot:
+ * while a push is preempted between taking its ticket and publishing its slot, try_pop()
+ * reports no item even if later slots are already published.
+ */
+template <typename T, typename A>
+class concurrent_queue<T, A, queue_mpsc> : public internal::queue_allocator_base<internal::mpsc_queue_base<T>, T, A> {
+	typedef internal::queue_allocator_base<internal::mpsc_queue_base<T>, T, A> base_type;
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_queue(const allocator_type& a = allocator_type()) : base_type(a) {}
+
+	// Destroy the remaining items; not thread-safe
+	~concurrent_queue() {
+		clear();
+		this->internal_finish_clear();
+	}
+
+	void push(const T& source) {this->internal_push(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& source) {this->internal_push(&source, base_type::move_construct_item);}
+#endif
+
+	// Enqueue copies of items[0..n) as one contiguous run
+	void push_n(const T* items, size_type n) {this->internal_push_n(items, n, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+	// Enqueue an item constructed in place from args
+	template <typename... Args>
+	void emplace(Args&&... args) {
+		internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		this->internal_push(&emplacer, &internal::item_emplacer<T, Args...>::construct_item);
+	}
+#endif
+
+	// Consumer thread only
+	bool try_pop(T& result) {return this->internal_try_pop(&result);}
+
+	// Move construct the head item in uninitialized storage; consumer thread only
+	bool try_pop_into(T* storage) {return this->internal_try_pop(storage, internal::move_construct_popped_item<T>);}
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+	// Consumer thread only
+	std::optional<T> try_pop() {
+		std::optional<T> result;
+		this->internal_try_pop(&result, internal::emplace_popped_item<T>);
+		return result;
+	}
+#endif
+
+	// Items pushed and not yet popped, counting pushes still in progress; consumer thread only
+	size_type unsafe_size() const {return this->internal_size();}
+
+	// Consumer thread only
+	bool empty() const {return this->internal_empty();}
+
+	// Pop all items; not thread-safe
+	void clear() {
+		while (this->internal_try_pop(NULL, NULL)) {}
+	}
+
+	allocator_type get_allocator() const {return this->my_allocator;}
+};
+
+#if __TBB_CAS16_PRESENT
+/*
+ * Lock-free multiple producer, multiple consumer queue (LCRQ)
+ *
+ * Pushes and pops take a ticket with one fetch-and-add on a ring of cells and
+ * settle the cell with a 16 byte CAS; nobody waits for another thread, where
+ * queue_mpmc waits for the holder of the previous ticket of its micro-queue and
+ * takes a lock to change pages. In exchange every item is a separate allocation
+ * from A, so a scalable allocator suits this queue best. A full ring is closed and
+ * followed by a new one of ring_size cells.
+ */
+template <typename T, typename A>
+class concurrent_queue<T, A, queue_lcrq> : public internal::queue_allocator_base<internal::lcrq_queue_base<T>, T, A> {
+	typedef internal::queue_allocator_base<internal::lcrq_queue_base<T>, T, A> base_type;
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_queue(const allocator_type& a = allocator_type()) : base_type(a) {
+		this->internal_init();
+	}
+
+	// Rings of ring_size cells, rounded up to a power of two; zero keeps the default of 1024
+	concurrent_queue(size_type ring_size, const allocator_type& a = allocator_type()) :
+		base_type(ring_size, a) {
+		this->internal_init();
+	}
+
+	// Destroy the remaining items; not thread-safe
+	~concurrent_queue() {
+		clear();
+		this->internal_finish_clear();
+	}
+
+	void push(const T& source) {this->internal_push(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& source) {this->internal_push(&source, base_type::move_construct_item);}
+#endif
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+	// Enqueue an item constructed in place from args
+	template <typename... Args>
+	void emplace(Args&&... args) {
+		internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		this->internal_push(&emplacer, &internal::item_emplacer<T, Args...>::construct_item);
+	}
+#endif
+
+	bool try_pop(T& result) {return this->internal_try_pop(&result);}
+
+	// Move construct the head item in uninitialized storage
+	bool try_pop_into(T* storage) {return this->internal_try_pop(storage, internal::move_construct_popped_item<T>);}
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+	std::optional<T> try_pop() {
+		std::optional<T> result;
+		this->internal_try_pop(&result, internal::emplace_popped_item<T>);
+		return result;
+	}
+#endif
+
+	// Number of items; not thread-safe
+	size_type unsafe_size() const {return this->internal_size();}
+
+	// Not reliable while the queue is modified concurrently
+	bool empty() const {return this->internal_empty();}
+
+	// Pop all items; not thread-safe
+	void clear() {
+		while (this->internal_try_pop(NULL, NULL)) {}
+	}
+
+	allocator_type get_allocator() const {return this->my_allocator;}
+};
+#endif /* __TBB_CAS16_PRESENT */
+
+}
+
+using strict_ppl::concurrent_queue;
+
+/*
+ * Bounded concurrent FIFO queue with blocking push and pop
+ *
+ * push() waits while size() has reached capacity(), pop() waits while the queue is
+ * empty. Waiting threads spin for a short, adaptive while and then sleep on a futex
+ * (Linux), and are woken by the pop or push that makes room or delivers their item.
+ * Waits allocate nothing: a blocked operation owns a ticket and parks on a shared
+ * event word.
+ *
+ * size() counts pending pops as negative items, like the classic bounded queue.
+ * The queue must not be destroyed while threads are blocked in it. Instrumentation
+ * is queue_plain or queue_instrumented, as for concurrent_queue.
+ */
+template <typename T, typename A = cache_aligned_allocator<T>, typename Instrumentation = queue_plain>
+class concurrent_bounded_queue : public strict_ppl::internal::queue_allocator_base<strict_ppl::internal::concurrent_bounded_queue_base<T>, T, A> {
+	typedef strict_ppl::internal::queue_allocator_base<strict_ppl::internal::concurrent_bounded_queue_base<T>, T, A> base_type;
+	static const bool instrumented = tbb::internal::is_same_type<Instrumentation, queue_instrumented>::value;
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef ptrdiff_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit concurrent_bounded_queue(const allocator_type& a = allocator_type()) :
+		base_type(size_t(0), size_t(0), instrumented, a) {}
+
+	// Queue spread over n_queue micro-queues with pages of items_per_page items, as for concurrent_queue
+	concurrent_bounded_queue(size_t n_queue, size_t items_per_page, const allocator_type& a = allocator_type()) :
+		base_type(n_queue, items_per_page, instrumented, a) {}
+
+	// Destroy the remaining items; not thread-safe
+	~concurrent_bounded_queue() {
+		clear();
+		this->internal_finish_clear();
+	}
+
+	// Enqueue a copy of source, waiting while the queue is full
+	void push(const T& source) {this->internal_push(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& source) {this->internal_push(&source, base_type::move_construct_item);}
+#endif
+
+	// Enqueue a copy of source unless the queue is full; returns true if it was pushed
+	bool try_push(const T& source) {return this->internal_push_if_not_full(&source, base_type::copy_construct_item);}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	bool try_push(T&& source) {return this->internal_push_if_not_full(&source, base_type::move_construct_item);}
+#endif
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+	// Enqueue an item constructed in place from args, waiting while the queue is full
+	template <typename... Args>
+	void emplace(Args&&... args) {
+		strict_ppl::internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		this->internal_push(&emplacer, &strict_ppl::internal::item_emplacer<T, Args...>::construct_item);
+	}
+
+	// Enqueue an item constructed in place from args unless the queue is full; returns true if it was pushed
+	template <typename... Args>
+	bool try_emplace(Args&&... args) {
+		strict_ppl::internal::item_emplacer<T, Args...> emplacer(std::forward<Args>(args)...);
+		return this->internal_push_if_not_full(&emplacer, &strict_ppl::internal::item_emplacer<T, Args...>::construct_item);
+	}
+#endif
+
+	// Move the head item into destination, waiting while the queue is empty
+	void pop(T& destination) {this->internal_pop(&destination);}
+
+	// Move the head item into destination if the queue is not empty; returns true if an item was popped
+	bool try_pop(T& destination) {return this->internal_pop_if_present(&destination);}
+
+	// Move the head item into destination, waiting at most timeout for one; returns true if an item was popped
+	bool pop_for(T& destination, const tick_count::interval_t& timeout) {return this->internal_pop_for(&destination, timeout);}
+
+	/*
+	 * Pops that move construct the head item in uninitialized storage for a T
+	 *
+	 * A popped item is owned by the caller. The item is moved once instead of assigned
+	 * to a constructed T, and T needs no default constructor.
+	 */
+	void pop_into(T* storage) {this->internal_pop(storage, strict_ppl::internal::move_construct_popped_item<T>);}
+
+	bool try_pop_into(T* storage) {return this->internal_pop_if_present(storage, strict_ppl::internal::move_construct_popped_item<T>);}
+
+	bool pop_for_into(T* storage, const tick_count::interval_t& timeout) {
+		return this->internal_pop_for(storage, timeout, strict_ppl::internal::move_construct_popped_item<T>);
+	}
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+	// The head item, or an empty optional if the queue is empty
+	std::optional<T> try_pop() {
+		std::optional<T> result;
+		this->internal_pop_if_present(&result, strict_ppl::internal::emplace_popped_item<T>);
+		return result;
+	}
+
+	// The head item, or an empty optional if none arrived within timeout
+	std::optional<T> pop_for(const tick_count::interval_t& timeout) {
+		std::optional<T> result;
+		this->internal_pop_for(&result, timeout, strict_ppl::internal::emplace_popped_item<T>);
+		return result;
+	}
+#endif
+
+	// Enqueue copies of items[0..n) as contiguous runs of at most capacity() items, waiting for room
+	void push_n(const T* items, size_type n) {this->internal_push_n(items, size_t(n), base_type::copy_construct_item);}
+
+	// Move up to n head items into destination[0..) without waiting; returns the number of items popped
+	size_type try_pop_n(T* destination, size_type n) {return size_type(this->internal_pop_n_if_present(destination, size_t(n)));}
+
+	// Number of items minus the number of threads blocked in pop()
+	size_type size() const {return this->internal_size();}
+
+	bool empty() const {return this->internal_size() <= 0;}
+
+	// Maximum number of items; pushes beyond it wait or fail
+	size_type capacity() const {return this->my_capacity;}
+
+	// Set the capacity; blocked pushes that now fit are woken
+	void set_capacity(size_type new_capacity) {this->internal_set_capacity(new_capacity);}
+
+	// Occupancy and latency counters as for concurrent_queue; the size leaves out pending pops
+	queue_statistics statistics() const {
+		queue_statistics s;
+		this->internal_statistics(s);
+		return s;
+	}
+
+	// Pop all items; not thread-safe
+	void clear() {
+		while (this->internal_pop_if_present(NULL, NULL)) {}
+	}
+
+	allocator_type get_allocator() const {return this->my_allocator;}
+};
+
+}
+
+#endif /* INCLUDE_TBB_CONCURRENT_QUEUE_H_ */
@@ -0,0 +1,335 @@
+/*
+ * concurrent_soa_vector.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_CONCURRENT_SOA_VECTOR_H_
+#define INCLUDE_TBB_CONCURRENT_SOA_VECTOR_H_
+
+#include "tbb_stddef.h"
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_TUPLE_PRESENT
+
+#include "tbb_exception.h"
+#include "atomic.h"
+#include "cache_aligned_allocator.h"
+#include "blocked_range.h"
+#include "concurrent_vector.h"
+#include <tuple>
+#include <cstring>
+
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+#include <type_traits>
+#endif
+
+namespace tbb {
+
+namespace internal {
+
+static void *const soa_allocation_failed_flag = reinterpret_cast<void*>(size_t(63));
+
+// Stores the address of every field of a tuple into a[0..N)
+template <size_t I, size_t N>
+struct tuple_field_addresses {
+	template <typename Tuple, typename Pointer>
+	static void apply(Tuple& t, Pointer* a) {
+		a[I] = &std::get<I>(t);
+		tuple_field_addresses<I+1,N>::apply(t, a);
+	}
+};
+
+template <size_t N>
+struct tuple_field_addresses<N,N> {
+	template <typename Tuple, typename Pointer>
+	static void apply(Tuple&, Pointer*) {}
+};
+
+template <typename... Types>
+struct soa_all_trivially_copyable;
+
+template <>
+struct soa_all_trivially_copyable<> {
+	static const bool value = true;
+};
+
+#if __TBB_CPP11_TYPE_PROPERTIES_PRESENT
+template <typename T, typename... Types>
+struct soa_all_trivially_copyable<T, Types...> {
+	static const bool value = std::is_trivially_copyable<T>::value && soa_all_trivially_copyable<Types...>::value;
+};
+#else
+template <typename T, typename... Types>
+struct soa_all_trivially_copyable<T, Types...> {
+	static const bool value = true;
+};
+#endif
+
+/*
+ * Range over one column of a concurrent_soa_vector
+ *
+ * Splits like blocked_range<size_t> over row indices. Inside a segment the rows
+ * of a column are contiguous, so scans should go through for_each_span(), which
+ * hands out one (pointer,length) pair per segment piece and leaves the inner loop
+ * free of segment lookups.
+ */
+template <typename U>
+class soa_column_range : public blocked_range<size_t>, private vector_segment_indexing {
+	atomic<void*> const* my_table;
+public:
+	typedef U value_type;
+	typedef blocked_range<size_t>::size_type size_type;
+
+	soa_column_range(atomic<void*> const* table, size_t begin_, size_t end_, size_t grainsize_ = 1) :
+		blocked_range<size_t>(begin_, end_, grainsize_), my_table(table) {}
+	soa_column_range(soa_column_range& r, split) : blocked_range<size_t>(r, split()), my_table(r.my_table) {}
+
+	U& operator[](size_t i) const {
+		segment_index_t k = segment_base_index_of(i);
+		return static_cast<U*>(my_table[k].load<relaxed>())[i];
+	}
+
+	// Call f(U* data, size_t n) for every contiguous piece of the range, in row order
+	template <typename F>
+	void for_each_span(F f) const {
+		for (size_t i = begin(); i < end();) {
+			segment_index_t k = segment_index_of(i);
+			size_t n = segment_base(k+1) - i;
+			if (n > end() - i) n = end() - i;
+			f(static_cast<U*>(my_table[k].load<relaxed>()) + (i - segment_base(k)), n);
+			i += n;
+		}
+	}
+};
+
+}
+
+/*
+ * Concurrent structure-of-arrays vector
+ *
+ * Rows are appended concurrently like in concurrent_vector, but every field is kept
+ * in a segment table of its own, so a scan over one column streams only that column
+ * through the cache. All columns share one size and concurrent_vector's segment
+ * geometry, so row i lives at the same segment offset in every column.
+ * Segments are cache line aligned and never fused, so a column piece of segment k
+ * always starts on a cache line.
+ *
+ * The column types must be trivially copyable (numeric data); rows are value
+ * initialized by grow_by() and copied in by push_back().
+ */
+template <typename... Types>
+class concurrent_soa_vector : private internal::vector_segment_indexing, internal::no_copy {
+	__TBB_STATIC_ASSERT(sizeof...(Types) > 0, "concurrent_soa_vector needs at least one column");
+	__TBB_STATIC_ASSERT(internal::soa_all_trivially_copyable<Types...>::value,
+	                    "concurrent_soa_vector columns must be trivially copyable");
+
+	enum {
+		n_columns = sizeof...(Types),
+		pointers_per_table = sizeof(segment_index_t) * 8
+	};
+
+public:
+	typedef vector_segment_indexing::size_type size_type;
+	typedef std::tuple<Types...> value_type;
+
+	template <size_t I>
+	struct column_type {
+		typedef typename std::tuple_element<I, value_type>::type type;
+		typedef internal::soa_column_range<type> range_type;
+		typedef internal::soa_column_range<const type> const_range_type;
+	};
+
+	concurrent_soa_vector() {
+		my_early_size.store<relaxed>(0);
+		for (size_type c = 0; c < n_columns; ++c)
+			for (size_type k = 0; k < pointers_per_table; ++k)
+				my_table[c][k].template store<relaxed>(NULL);
+	}
+
+	~concurrent_soa_vector() {
+		for (size_type c = 0; c < n_columns; ++c)
+			for (size_type k = 0; k < pointers_per_table; ++k) {
+				void* array = my_table[c][k].template load<relaxed>();
+				if (array > internal::soa_allocation_failed_flag)
+					internal::NFS_Free(array);
+			}
+	}
+
+	/*
+	 * Concurrent operations
+	 */
+
+	// Append delta value initialized rows, returns the index of the first one
+	size_type grow_by(size_type delta) {
+		size_type base = my_early_size.fetch_and_add(delta);
+		internal_grow(base, base+delta, NULL);
+		return base;
+	}
+
+	// Append one row, returns its index
+	size_type push_back(const Types&... values) {
+		const void* fields[n_columns] = {&values...};
+		size_type index = my_early_size.fetch_and_add(1);
+		internal_grow(index, index+1, fields);
+		return index;
+	}
+
+	size_type push_back(const value_type& row) {
+		const void* fields[n_columns];
+		internal::tuple_field_addresses<0,n_columns>::apply(row, fields);
+		size_type index = my_early_size.fetch_and_add(1);
+		internal_grow(index, index+1, fields);
+		return index;
+	}
+
+	// Field I of row i; the row must have been published by external synchronization
+	template <size_t I>
+	typename column_type<I>::type& get(size_type i) {
+		return *static_cast<typename column_type<I>::type*>(internal_field(I, i));
+	}
+	template <size_t I>
+	const typename column_type<I>::type& get(size_type i) const {
+		return *static_cast<const typename column_type<I>::type*>(internal_field(I, i));
+	}
+
+	// Copy of row i
+	value_type row(size_type i) const {
+		value_type result;
+		void* fields[n_columns];
+		internal::tuple_field_addresses<0,n_columns>::apply(result, fields);
+		for (size_type c = 0; c < n_columns; ++c)
+			std::memcpy(fields[c], internal_field(c, i), column_size(c));
+		return result;
+	}
+
+	// Rows [0,size()) of column I
+	template <size_t I>
+	typename column_type<I>::range_type column_range(size_t grainsize = 1) {
+		return typename column_type<I>::range_type(my_table[I], 0, size(), grainsize);
+	}
+	template <size_t I>
+	typename column_type<I>::const_range_type column_range(size_t grainsize = 1) const {
+		return typename column_type<I>::const_range_type(my_table[I], 0, size(), grainsize);
+	}
+
+	// Allocate the segments of all columns for at least n rows; may run concurrently with growth
+	void reserve(size_type n) {
+		for (segment_index_t k = 0; n && segment_base(k) < n; ++k)
+			internal_segment(k, /*owner=*/true);
+	}
+
+	/*
+	 * Capacity
+	 */
+	size_type size() const {return my_early_size;}
+	bool empty() const {return !my_early_size;}
+
+	// Remove all rows but keep the segments; not thread-safe
+	void clear() {my_early_size = 0;}
+
+private:
+	atomic<size_type> my_early_size;
+	atomic<void*> my_table[n_columns][pointers_per_table];
+
+	static size_type column_size(size_type c) {
+		static const size_type sizes[n_columns] = {sizeof(Types)...};
+		return sizes[c];
+	}
+
+	// Number of rows in segment k; segment 0 holds two rows like segment 1
+	static size_type segment_rows(segment_index_t k) {
+		return segment_base(k+1) - segment_base(k);
+	}
+
+	void* internal_field(size_type c, size_type i) const {
+		__TBB_ASSERT(i < my_early_size, "index out of bounds");
+		segment_index_t k = segment_base_index_of(i);
+		void* array = my_table[c][k].template load<relaxed>();
+		__TBB_ASSERT(array > internal::soa_allocation_failed_flag, "the row is not allocated");
+		return static_cast<char*>(array) + i*column_size(c);
+	}
+
+	void internal_segment(segment_index_t k, bool owner);
+	void internal_grow(size_type start, size_type finish, const void* const* fields);
+};
+
+/*
+ * Make segment k of every column available
+ *
+ * As in concurrent_vector the owner is the thread whose grow range includes the first
+ * row of the segment; it allocates the columns, every other thread waits for them.
+ * reserve() may race with the owner, so slots are published with compare_and_swap.
+ */
+template <typename... Types>
+void concurrent_soa_vector<Types...>::internal_segment(segment_index_t k, bool owner) {
+	for (size_type c = 0; c < n_columns; ++c) {
+		atomic<void*>& slot = my_table[c][k];
+		void* array = slot.template load<acquire>();
+		if (!array) {
+			if (owner) {
+				void* new_array = NULL;
+				__TBB_TRY {
+					new_array = internal::NFS_Allocate(segment_rows(k), column_size(c), NULL);
+				} __TBB_CATCH(...) {
+					for (size_type d = c; d < n_columns; ++d)
+						my_table[d][k].compare_and_swap(internal::soa_allocation_failed_flag, NULL);
+					__TBB_RETHROW();
+				}
+				array = slot.compare_and_swap(new_array, NULL);
+				if (array)
+					internal::NFS_Free(new_array);
+				else
+					array = new_array;
+			} else {
+				for (internal::atomic_backoff backoff; !(array = slot.template load<acquire>()); backoff.pause()) {}
+			}
+		}
+		if (array == internal::soa_allocation_failed_flag)
+			internal::throw_exception(internal::eid_bad_last_alloc);
+	}
+}
+
+template <typename... Types>
+void concurrent_soa_vector<Types...>::internal_grow(size_type start, size_type finish, const void* const* fields) {
+	if (start == finish)
+		return;
+	// Allocate every segment the range owns before filling any: when one fails, the
+	// rest are flagged too, so no thread waits for a segment that is never allocated
+	segment_index_t k_begin = segment_index_of(start), k_end = segment_index_of(finish-1) + 1;
+	if (start != segment_base(k_begin))
+		++k_begin;
+	for (segment_index_t k = k_begin; k < k_end; ++k) {
+		__TBB_TRY {
+			internal_segment(k, /*owner=*/true);
+		} __TBB_CATCH(...) {
+			for (++k; k < k_end; ++k)
+				for (size_type c = 0; c < n_columns; ++c)
+					my_table[c][k].compare_and_swap(internal::soa_allocation_failed_flag, NULL);
+			__TBB_RETHROW();
+		}
+	}
+	while (start < finish) {
+		segment_index_t k = segment_index_of(start);
+		size_type n = segment_base(k+1) - start;
+		if (n > finish - start) n = finish - start;
+		internal_segment(k, start == segment_base(k));
+		size_type offset = start - segment_base(k);
+		for (size_type c = 0; c < n_columns; ++c) {
+			char* dst = static_cast<char*>(my_table[c][k].template load<relaxed>()) + offset*column_size(c);
+			if (fields) {
+				__TBB_ASSERT(n == 1, "rows are copied in one at a time");
+				std::memcpy(dst, fields[c], column_size(c));
+			} else {
+				// Value initialization of trivially copyable fields
+				std::memset(dst, 0, n*column_size(c));
+			}
+		}
+		start += n;
+	}
+}
+
+}
+
+#endif /* __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_TUPLE_PRESENT */
+
+#endif /* INCLUDE_TBB_CONCURRENT_SOA_VECTOR_H_ */
@@ -15,10 +15,14 @@
 #include "blocked_range.h"
 #include "tbb_machine.h"
 #include "tbb_profiling.h"
+#include "spin_mutex.h"
+#include "internal/_parallel_chunk_impl.h"
 #include <new>
 #include <cstring>
 #include __TBB_STD_SWAP_HEADER
 #include <algorithm>
+#include <functional>
+#include <vector>
 #include <iterator>
 
 #if _MSC_VER==1500 && !__INTEL_COMPILER
@@ -47,11 +51,28 @@ namespace tbb {
 template <typename T, class A = cache_aligned_allocator<T>>
 class concurrent_vector;
 
+// Memory held by a concurrent_vector, see concurrent_vector::memory_usage()
+struct vector_memory_usage {
+	// Element storage of the allocated segments
+	size_t bytes_allocated;
+	// Storage of the size() elements
+	size_t bytes_used;
+	// Allocated storage past the last element, also segments reserved ahead of it
+	size_t wasted_tail_bytes;
+	// Segment table allocated outside the vector object, 0 while the embedded table suffices
+	size_t table_bytes;
+	// Allocated segments; the fused first block is one allocation and counts once
+	size_t segments;
+};
+
 namespace internal {
 
 template <typename Container, typename Value>
 class vector_iterator;
 
+template <typename T, class A, typename Compare>
+class concurrent_vector_sorter;
+
 static void *const vector_allocator_error_flag = reinterpret_cast<void*>(size_t(63));
 
 template <typename T>
@@ -59,17 +80,59 @@ void handle_unconstructed_elements(T* array, size_t n_of_elements) {
 	std::memset(static_cast<void*>(array), 0, n_of_elements *sizeof(T));
 }
 
-// Base class of concurrent vector implementation
-
-class concurrent_vector_base_v3 {
+/*
+ * Geometry of the segment table
+ *
+ * Shared by the containers that lay out their elements the way concurrent_vector does:
+ * segment k holds elements [segment_base(k), segment_base(k+1)).
+ */
+class vector_segment_indexing {
 protected:
 	typedef size_t segment_index_t;
 	typedef size_t size_type;
 
+	/*
+	 * These helpers methods use the fact that segments are allocated
+	 * so that every segments size is a increasing power of 2,
+	 * with one exception 0 segment has size of 2 as well segment 1
+	 */
+	static segment_index_t segment_index_of (size_type index) {
+		return segment_index_t(__TBB_Log2(index|1));
+	}
+	static segment_index_t segment_base(segment_index_t k) {
+		return (segment_index_t(1)<<k & ~segment_index_t(1));
+	}
+	static inline segment_index_t segment_base_index_of(segment_index_t& index) {
+		segment_index_t k = segment_index_of(index);
+		index -= segment_base(k);
+		return k;
+	}
+	static size_type segment_size(segment_index_t k) {
+		return segment_index_t(1)<<k;
+	}
+	static bool is_first_element_in_segment(size_type element_index) {
+		__TBB_ASSERT(element_index, "there should be no need to call "
+		"is_first_element_in_segment for 0th element" );
+		return is_power_of_two_at_least(element_index,2);
+	}
+};
+
+// Base class of concurrent vector implementation
+
+class concurrent_vector_base_v3 : protected vector_segment_indexing {
+protected:
+	typedef vector_segment_indexing::segment_index_t segment_index_t;
+	typedef vector_segment_indexing::size_type size_type;
+
 	enum {
 		default_initial_segments = 1,
 		pointers_per_short_table = 3,
-		pointers_per_long_table = sizeof(segment_index_t) * 8
+		pointers_per_long_table = sizeof(segment_index_t) * 8,
+		// Bulk construction of fewer bytes than this stays on the calling thread;
+		// see benchmarks/bulk_construction_bench.cpp for where waking the helpers pays
+		parallel_construction_threshold = 1<<22,
+		// Bytes of elements a thread constructs per chunk in bulk construction
+		parallel_construction_grainsize = 1<<16
 	};
 
 	struct segment_not_used {};
@@ -175,28 +238,37 @@ protected:
 	__TBB_EXPORTED_METHOD ~concurrent_vector_base_v3();
 
 	/*
-	 * These helpers methods use the fact that segments are allocated
-	 * so that every segments size is a increasing power of 2,
-	 * with one exception 0 segment has size of 2 as well segment 1
+	 * Address of element index of vector v, run receives the number of elements
+	 * that follow it contiguously in the same segment (the element itself included)
 	 */
-	static segment_index_t segment_index_of (size_type index) {
-		return segment_index_t(__TBB_Log2(index|1));
-	}
-	static segment_index_t segment_base(segment_index_t k) {
-		return (segment_index_t(1)<<k & ~segment_index_t(1));
-	}
-	static inline segment_index_t segment_base_index_of(segment_index_t& index) {
+	static void* internal_element_run(const concurrent_vector_base_v3& v, size_type index, size_type element_size, size_type& run) {
 		segment_index_t k = segment_index_of(index);
-		index -= segment_base(k);
-		return k;
+		run = segment_base(k+1) - index;
+		segment_value_t segment_value = v.my_segment.load<acquire>()[k].load<relaxed>();
+		enfore_segment_allocated(segment_value);
+		return static_cast<char*>(segment_value.pointer<void>()) + (index - segment_base(k))*element_size;
 	}
-	static size_type segment_size(segment_index_t k) {
-		return segment_index_t(1)<<k;
+
+	// Bytes held by the allocated segments; the fused first block counts once, as does its allocation in *segments
+	size_type internal_allocated_bytes(size_type element_size, size_type* segments = NULL) const {
+		segment_t* table = my_segment.load<acquire>();
+		segment_index_t n_segments = table == my_storage ? pointers_per_short_table : pointers_per_long_table;
+		segment_index_t first_block = my_first_block;
+		size_type bytes = 0, count = 0;
+		for (segment_index_t k = 0; k < n_segments; ++k) {
+			if (k && k < first_block) continue;
+			if (table[k].load<relaxed>() == segment_allocated()) {
+				bytes += segment_size(k ? k : first_block)*element_size;
+				++count;
+			}
+		}
+		if (segments) *segments = count;
+		return bytes;
 	}
-	static bool is_first_element_in_segment(size_type element_index) {
-		__TBB_ASSERT(element_index, "there should be no need to call "
-		"is_first_element_in_segment for 0th element" );
-		return is_power_of_two_at_least(element_index,2);
+
+	// Bytes of the segment table when it has outgrown the embedded storage
+	size_type internal_table_bytes() const {
+		return my_segment.load<acquire>() == my_storage ? 0 : size_type(pointers_per_long_table)*sizeof(segment_t);
 	}
 
 	// An operation on an n-element array starting at begin
@@ -218,7 +290,7 @@ protected:
 			                                         internal_array_op2 init, const void* src);
 	void* __TBB_EXPORTED_METHOD internal_push_back(size_type element_size, size_type& index);
 	segment_index_t __TBB_EXPORTED_METHOD internal_clear(internal_array_op1 destroy);
-	void* __TBB_EXPORTED_METHOD intenal_compact(size_type element_size, void* table, internal_array_op1 destroy,
+	void* __TBB_EXPORTED_METHOD internal_compact(size_type element_size, void* table, internal_array_op1 destroy,
 			                                    internal_array_op2 copy);
 	void __TBB_EXPORTED_METHOD internal_copy(const concurrent_vector_base_v3& src, size_type element_size,
 			                                 internal_array_op2 copy);
@@ -420,6 +492,93 @@ ptrdiff_t operator - (const vector_iterator<Container,T>& i, const vector_iterat
 	return ptrdiff_t(i.my_index) - ptrdiff_t(j.my_index);
 }
 
+/*
+ * Number of leading elements whose construction has completed
+ *
+ * Growth reserves indices with a fetch-and-add on my_early_size and constructs
+ * them afterwards, so size() may cover elements that are still being built.
+ * Every growing thread publishes its range here once the range is constructed,
+ * or zeroed after its construction failed.
+ * A range that starts at the published prefix extends it with one CAS and takes
+ * no lock unless out of order ranges are pending. Any other range is kept as
+ * pending under my_mutex, and is absorbed by the range that reaches it, so a
+ * producer never waits for the construction of another one.
+ * Only a growth whose reservation failed leaves a range that is never published;
+ * the prefix stops in front of it until a non-concurrent operation resets the vector.
+ */
+class vector_publication : no_copy {
+	atomic<size_t> my_size;
+	// Number of ranges in my_pending, read by the lock-free path
+	atomic<size_t> my_pending_count;
+	spin_mutex my_mutex;
+	// Published ranges above the prefix, [first,second), adjacent ones merged,
+	// sorted by descending first so that the range next to the prefix is at the back
+	std::vector<std::pair<size_t,size_t> > my_pending;
+public:
+	vector_publication() {
+		my_size.store<relaxed>(0);
+		my_pending_count.store<relaxed>(0);
+	}
+
+	size_t size() const {return my_size.load<acquire>();}
+
+	void publish(size_t begin, size_t end) {
+		if (my_size.compare_and_swap(end, begin) == begin) {
+			// The CAS and the count increment in add_pending are both full fences,
+			// so either this thread sees the pending range or its owner sees the new prefix
+			if (my_pending_count.load<acquire>() == 0)
+				return;
+			spin_mutex::scoped_lock lock(my_mutex);
+			absorb_pending();
+			return;
+		}
+		spin_mutex::scoped_lock lock(my_mutex);
+		add_pending(begin, end);
+		absorb_pending();
+	}
+
+	// Restart publication at n elements; not thread-safe, used by the non-concurrent operations
+	void reset(size_t n) {
+		my_pending.clear();
+		my_pending_count.store<relaxed>(0);
+		my_size.store<release>(n);
+	}
+
+private:
+	// Extend the prefix over the pending ranges it reaches; my_mutex is held
+	void absorb_pending() {
+		while (!my_pending.empty() && my_pending.back().first == my_size.load<acquire>()) {
+			// No other range starts at the prefix, so no publisher races with this store
+			my_size.store<release>(my_pending.back().second);
+			my_pending.pop_back();
+			my_pending_count.store<relaxed>(my_pending.size());
+		}
+	}
+
+	void add_pending(size_t begin, size_t end) {
+		typedef std::vector<std::pair<size_t,size_t> >::iterator iterator;
+		iterator i = std::lower_bound(my_pending.begin(), my_pending.end(), std::make_pair(begin, end),
+				std::greater<std::pair<size_t,size_t> >());
+		// *i is the first range below [begin,end), *(i-1) the last one above it
+		if (i != my_pending.begin() && (i-1)->first == end) {
+			(i-1)->first = begin;
+			--i;
+		} else {
+			__TBB_TRY {
+				i = my_pending.insert(i, std::make_pair(begin, end));
+			} __TBB_CATCH(...) {
+				// Out of memory: the range stays unpublished, like one whose reservation failed
+				return;
+			}
+		}
+		if (i+1 != my_pending.end() && (i+1)->second == begin) {
+			(i+1)->second = i->second;
+			my_pending.erase(i);
+		}
+		my_pending_count.fetch_and_store(my_pending.size());
+	}
+};
+
 template <typename T, class A>
 class allocator_base {
 public:
@@ -446,10 +605,21 @@ private:
 		template <typename U>
 		generic_range_type(const generic_range_type<U>& r) : blocked_range<I>(r.begin(), r.end(), r.grainsize()) {}
 		generic_range_type(generic_range_type& r, split) : blocked_range<I>(r,split()) {}
+
+		// Call f(pointer, n) for every contiguous piece of the range, in index order
+		template <typename F>
+		void for_each_span(F f) const {
+			if (this->empty()) return;
+			I first = this->begin();
+			first.my_vector->template internal_for_each_span<typename I::pointer>(first.my_index, this->end().my_index, f);
+		}
 	};
 	
 	template <typename C, typename U>
 	friend class internal::vector_iterator;
+
+	template <typename T_, class A_, typename Compare>
+	friend class internal::concurrent_vector_sorter;
 				 
 public:
 	typedef internal::concurrent_vector_base_v3::size_type size_type;
@@ -510,7 +680,7 @@ public:
 	{
 		vector_allocator_ptr = &internal_allocator;
 		__TBB_TRY {
-			internal_copy(vector, sizeof(T), &copy_array);
+			internal_parallel_copy(vector, vector.size(), &copy_array);
 		} __TBB_CATCH(...) {
 			segment_t *table = my_segment.load<relaxed>();
 			internal_free_segments(table, internal_clear(&destroy_array), my_first_block.load<relaxed>());
@@ -524,6 +694,8 @@ concurrent_vector(concurrent_vector&& source)
 {
   vector_allocator_ptr = &internal_allocator;
   concurrent_vector_base_v3::internal_swap(source);
+  my_publication.reset(size());
+  source.my_publication.reset(source.size());
 }
 
 concurrent_vector(concurrent_vector&& source, const allocator_type& a)
@@ -532,11 +704,13 @@ concurrent_vector(concurrent_vector&& source, const allocator_type& a)
   vector_allocator_ptr = &internal_allocator;
   if (a == source.my_allocator) {
     concurrent_vector_base_v3::internal_swap(source);
+    my_publication.reset(size());
+    source.my_publication.reset(source.size());
   }
   else
   {
     __TBB_TRY {
-      internal_copy(source, sizeof(T), &move_array);
+      internal_parallel_copy(source, source.size(), &move_array);
     } __TBB_CATCH(...) {
       segment_t *table = my_segment.load<relaxed>();
       internal_free_segments(table, internal_clear(&destroy_array), my_first_block.load<relaxed>());
@@ -555,7 +729,7 @@ concurrent_vector(const concurrent_vector<T,M>& vector, const allocator_type& a
 {
 	vector_allocator_ptr = &internal_allocator;
 	__TBB_TRY {
-		internal_copy(vector.internal_vector_base(), sizeof(T), &copy_array);
+		internal_parallel_copy(vector.internal_vector_base(), vector.size(), &copy_array);
 	} __TBB_CATCH(...) {
 		segment_t *table = my_segment.load<relaxed>();
 		internal_free_segments(table, internal_clear(&destroy_array), my_first_block.load<relaxed>());
@@ -568,7 +742,7 @@ explicit concurrent_vector(size_type n)
 {
 	vector_allocator_ptr = &internal_allocator;
 	__TBB_TRY {
-		internal_resize(n, sizeof(T), max_size(), NULL, &destroy_array, &initialize_array);
+		internal_parallel_resize(n, NULL, &initialize_array);
 	} __TBB_CATCH(...) {
 		segment_t *table = my_segment.load<relaxed>();
 		internal_free_segments(table, internal_clear(&destroy_array), my_first_block.load<relaxed>());
@@ -584,7 +758,7 @@ concurrent_vector(size_type n, const_reference t, const allocator_type& a = allo
 {
 	vector_allocator_ptr = &internal_allocator;
 	__TBB_TRY {
-		internal_resize(n, sizeof(T), max_size(), static_cast<const void*>(&t), &destroy_array, &initialize_array_by);
+		internal_parallel_resize(n, static_cast<const void*>(&t), &initialize_array_by);
 	} __TBB_CATCH(...) {
 		segment_t *table = my_segment.load<relaxed>();
 		internal_free_segments(table, internal_clear(&destroy_array), my_first_block.load<relaxed>());
@@ -613,7 +787,7 @@ concurrent_vector& operator=(const concurrent_vector& vector)
 {
 	if (this != &vector)
 	{
-		internal_assign(vector, sizeof(T), &destroy_array, &assign_array, &copy_array);
+		internal_parallel_assign(vector, vector.size(), &assign_array, &copy_array);
 	}
 	return *this;
 }
@@ -626,6 +800,8 @@ concurrent_vector& operator=(concurrent_vector&& other) {
   {
     concurrent_vector trash(std::move(*this));
     internal_swap(other);
+    my_publication.reset(size());
+    other.my_publication.reset(other.size());
     if (pocma_t::value)
     {
       this->my_allocator = std::move(other.my_allocator);
@@ -633,7 +809,7 @@ concurrent_vector& operator=(concurrent_vector&& other) {
   }
   else
   {
-    internal_assign(other, sizeof(T), &destroy_array, &move_assign_array, &move_array);
+    internal_parallel_assign(other, other.size(), &move_assign_array, &move_array);
   }
   return *this;
 }
@@ -643,15 +819,14 @@ template <class M>
 concurrent_vector& operator=(const concurrent_vector<T,M>& vector) {
 	if (static_cast<void*>(this) != static_cast<const void*>(&vector))
 	{
-		internal_assign(vector.internal_vector_base(), sizeof(T),
-				&destroy_array, &assign_array, &copy_array);
+		internal_parallel_assign(vector.internal_vector_base(), vector.size(), &assign_array, &copy_array);
 		return *this;
 	}
 }
 
 #if __TBB_INITIALIZER_LISTS_PRESENT
 concurrent_vector& operator=(std::initializer_list<T> init_list) {
-  internal_clear(&destroy_array);
+  clear();
   internal_assign_iterators(init_list.begin(), init_list.end());
   return *this;
 }
@@ -665,14 +840,14 @@ concurrent_vector& operator=(std::initializer_list<T> init_list) {
  * Grow by "delta" elements
  */
 iterator grow_by(size_type delta) {
-	return iterator(*this, delta ? internal_grow_by(delta, sizeof(T), &initialize_array, NULL) : my_early_size.load());
+	return iterator(*this, delta ? internal_published_grow_by(delta, &initialize_array, NULL) : my_early_size.load());
 }
 
 /*
  * Grow by "delta" elements using copying constructor
  */
 iterator grow_by(size_type delta, const_reference t) {
-	return iterator(*this, delta ? internal_grow_by(delta, sizeof(T), &initialize_array_by,
+	return iterator(*this, delta ? internal_published_grow_by(delta, &initialize_array_by,
 			static_cast<const void*>(&t)) : my_early_size.load());
 }
 
@@ -680,8 +855,9 @@ template <typename I>
 iterator grow_by(I first, I last) {
 	typename std::iterator_traits<I>::difference_type delta = std::distance(first, last);
 	__TBB_ASSERT(delta >= 0, NULL);
-	return iterator(*this, delta ? internal_grow_by(delta, sizeof(T), &copy_range<I>,
-			static_cast<const void*>(&first)) : my_early_size.load());
+	if (!delta)
+		return iterator(*this, my_early_size.load());
+	return iterator(*this, internal_grow_by_range(first, delta, typename std::iterator_traits<I>::iterator_category()));
 }
 
 #if __TBB_INITIALIZER_LISTS_PRESENT
@@ -702,7 +878,7 @@ iterator grow_by( std::initializer_list<T> init_list ) {
 iterator grow_to_at_least(size_type n) {
 	size_type m = 0;
 	if (n) {
-		m = internal_grow_to_at_least_with_result(n, sizeof(T), &initialize_array, NULL);
+		m = internal_published_grow_to_at_least(n, &initialize_array, NULL);
 		if (m > n) m = n;
 	}
 	return iterator(*this,m);
@@ -715,7 +891,7 @@ iterator grow_to_at_least(size_type n) {
 iterator grow_to_at_least(size_type n, const_reference t) {
 	size_type m = 0;
 	if (n) {
-		m = internal_grow_to_at_least_with_result(n, sizeof(T), &initialize_array_by, &t);
+		m = internal_published_grow_to_at_least(n, &initialize_array_by, &t);
 		if (m > n) m = n;
 	}
 	return iterator(*this,m);
@@ -776,6 +952,22 @@ const_range_type range(size_t grainsize = 1) const {
 	return const_range_type(begin(), end(), grainsize);
 }
 
+/*
+ * Range over the published prefix of the vector
+ *
+ * Unlike range(), which ends at size() and may include elements still under
+ * construction by other threads, it only covers fully constructed elements.
+ * Consumers can tail a vector that producers keep growing by remembering
+ * where the previous consistent_range() ended.
+ */
+range_type consistent_range(size_t grainsize = 1) {
+	return range_type(begin(), iterator(*this, published_size()), grainsize);
+}
+
+const_range_type consistent_range(size_t grainsize = 1) const {
+	return const_range_type(begin(), const_iterator(*this, published_size()), grainsize);
+}
+
 /*
  * Capacity
  */
@@ -787,8 +979,28 @@ size_type size() const {
 
 bool empty() const {return !my_early_size;}
 
+// Number of leading elements that are fully constructed, never more than size()
+size_type published_size() const {return my_publication.size();}
+
 size_type capacity() const {return internal_capacity();}
 
+/*
+ * Bytes allocated and used by the vector
+ *
+ * Reads the segment table without locking; during concurrent growth the figures
+ * are a snapshot that may already be stale.
+ */
+vector_memory_usage memory_usage() const {
+	vector_memory_usage usage;
+	size_type segments;
+	usage.bytes_allocated = internal_allocated_bytes(sizeof(T), &segments);
+	usage.segments = segments;
+	usage.bytes_used = size()*sizeof(T);
+	usage.wasted_tail_bytes = usage.bytes_allocated > usage.bytes_used ? usage.bytes_allocated - usage.bytes_used : 0;
+	usage.table_bytes = internal_table_bytes();
+	return usage;
+}
+
 void reserve(size_type n) {
 	if (n)
 	{
@@ -797,14 +1009,18 @@ void reserve(size_type n) {
 }
 
 void resize(size_type n) {
-	internal_resize(n,sizeof(T), max_size(), NUll, &destroy_array, &initialize_array);
+	internal_parallel_resize(n, NULL, &initialize_array);
 }
 
 void resize(size_type n, const_reference t) {
-	internal_resize(n,sizeof(T), max_size(), static_cast<const void*>(&t), &destroy_array, &initialize_array_by);
+	internal_parallel_resize(n, static_cast<const void*>(&t), &initialize_array_by);
 }
 
-void shrink_to_fit();
+/*
+ * Fuse the segments holding the elements into one first block and free the unused tail segments.
+ * Returns the number of bytes given back to the allocator; not thread-safe.
+ */
+size_type shrink_to_fit();
 size_type max_size() const {return (~size_type(0))/sizeof(T);}
 
 
@@ -849,7 +1065,7 @@ const_reference back() const {
 allocator_type get_allocator() const {return this->my_allocator;}
 void assign(size_type n, const_reference t) {
 	clear();
-	internal_resize(n,sizeof(T),max_size(),static_cast<const void*>(&t),&destroy_array,&internal_array_by);
+	internal_parallel_resize(n, static_cast<const void*>(&t), &initialize_array_by);
 }
 template <typename I>
 void assign(I first, I last) {
@@ -869,11 +1085,14 @@ void swap(concurrent_vector &vector) {
 	{
 		concurrent_vector_base_v3::internal_swap(static_cast<concurrent_vector_base_v3&>(vector));
 		swap(this->my_allocator, vector.my_allocator);
+		my_publication.reset(size());
+		vector.my_publication.reset(vector.size());
 	}
 }
 
 void clear() {
 	internal_clear(&destroy_array);
+	my_publication.reset(0);
 }
 
 ~concurrent_vector() {
@@ -881,9 +1100,26 @@ void clear() {
 	internal_free_segements(table, internal_clear(&destroy_array),my_first_block.load<relaxed>());
 }
 
+/*
+ * Call f(pointer, n) for every contiguous piece of elements [begin,end), in index order
+ *
+ * A piece never crosses a segment boundary, so f works on plain arrays and its loops
+ * can be vectorized, unlike loops over iterators that look up the segment per element.
+ */
+template <typename F>
+void for_each_span(size_type begin, size_type end, F f) {
+	internal_for_each_span<pointer>(begin, end, f);
+}
+template <typename F>
+void for_each_span(size_type begin, size_type end, F f) const {
+	internal_for_each_span<const_pointer>(begin, end, f);
+}
+
 const internal::concurrent_vector_base_v3 &internal_vector_base() const {return *this;}
 
 private:
+internal::vector_publication my_publication;
+
 static void *internal_allocator(internal::concurrent_vector_base_v3& vb, size_t k) {
 	return static_cast<concurrent_vector<T,A>&>(vb).my_allocator.allocate(k);
 }
@@ -893,7 +1129,7 @@ T& internal_subscript(size_type index) const;
 T& internal_subscript_with_exceptions(size_type index) const;
 
 void internal_assign_n(size_type n, const_pointer p) {
-	internal_resize(n,sizeof(T),max_size(),static_cast<const void*>(p), &destroy_array, p ? &initialize_array_by : &initialize_array);
+	internal_parallel_resize(n, static_cast<const void*>(p), p ? &initialize_array_by : &initialize_array);
 }
 
 template <bool B> class is_integer_tag;
@@ -905,10 +1141,217 @@ void internal_assign_range(I first, I last, is_integer_tag<true> *) {
 
 template <class I>
 void internal_assign_range(I first, I last, is_integer_tag<false> *) {
-	internal_assign_iterators(first,last);
+	internal_assign_iterators(first, last, typename std::iterator_traits<I>::iterator_category());
+}
+
+template <class I>
+void internal_assign_iterators(I first, I last);
+
+template <class I>
+void internal_assign_iterators(I first, I last, std::input_iterator_tag) {
+	internal_assign_iterators(first, last);
+}
+
+template <class I>
+void internal_assign_iterators(I first, I last, std::random_access_iterator_tag) {
+	__TBB_ASSERT(my_early_size == 0, NULL);
+	size_type n = last - first;
+	if (n*sizeof(T) < size_type(parallel_construction_threshold)) {
+		internal_assign_iterators(first, last);
+		return;
+	}
+	internal_reserve(n, sizeof(T), max_size());
+	my_early_size = n;
+	internal_parallel_construct(0, n, iterator_source<I>(first, 0));
+	my_publication.reset(n);
+}
+
+template <class I>
+size_type internal_grow_by_range(I first, size_type delta, std::input_iterator_tag) {
+	size_type base = internal_grow_by(delta, sizeof(T), &uninitialized_array, NULL);
+	internal_published_construct(base, base+delta, input_source<I>(first), false);
+	return base;
+}
+
+template <class I>
+size_type internal_grow_by_range(I first, size_type delta, std::random_access_iterator_tag) {
+	size_type base = internal_grow_by(delta, sizeof(T), &uninitialized_array, NULL);
+	internal_published_construct(base, base+delta, iterator_source<I>(first, base), true);
+	return base;
+}
+
+/*
+ * Bulk construction that splits the element range across threads
+ *
+ * Each chunk is cut at segment boundaries, so a thread always hands
+ * contiguous runs of elements to the array operations. Ranges below
+ * parallel_construction_threshold bytes go through the serial library routines instead.
+ */
+void internal_parallel_copy(const internal::concurrent_vector_base_v3& src, size_type n, internal_array_op2 copy);
+void internal_parallel_assign(const internal::concurrent_vector_base_v3& src, size_type n,
+		                      internal_array_op2 assign, internal_array_op2 copy);
+void internal_parallel_resize(size_type n, const void* src, internal_array_op2 init);
+
+/*
+ * Concurrent growth that publishes the new elements once they are constructed
+ *
+ * The indices are reserved first and constructed afterwards, so the grown range is
+ * known even when construction throws: its failed elements are zeroed and the range
+ * is published anyway, and the published prefix moves past it.
+ */
+size_type internal_published_grow_by(size_type delta, internal_array_op2 init, const void* src);
+size_type internal_published_grow_to_at_least(size_type n, internal_array_op2 init, const void* src);
+template <typename Source>
+void internal_published_construct(size_type begin, size_type end, const Source& source, bool parallel);
+template <typename Source>
+void internal_parallel_construct(size_type begin, size_type end, const Source& source);
+void internal_parallel_compact();
+
+template <typename P, typename F>
+void internal_for_each_span(size_type begin, size_type end, F& f) const {
+	__TBB_ASSERT(begin <= end && end <= my_early_size, "range out of bounds");
+	for (size_type run; begin < end; begin += run) {
+		P array = static_cast<P>(internal_element_run(*this, begin, sizeof(T), run));
+		if (run > end - begin) run = end - begin;
+		f(array, run);
+	}
 }
 
+// Every element is initialized by init from the same source
+class fill_source : internal::no_assign {
+	internal_array_op2 my_init;
+	const void* my_src;
+public:
+	fill_source(internal_array_op2 init, const void* src) : my_init(init), my_src(src) {}
+	void construct(void* dst, size_type, size_type n) const {my_init(dst, my_src, n);}
+};
+
+// Element i is copied (or moved) from element i of another vector
+class vector_source : internal::no_assign {
+	const internal::concurrent_vector_base_v3& my_vector;
+	internal_array_op2 my_copy;
+public:
+	vector_source(const internal::concurrent_vector_base_v3& v, internal_array_op2 copy) : my_vector(v), my_copy(copy) {}
+	void construct(void* dst, size_type i, size_type n) const {
+		size_type run;
+		const void* src = internal_element_run(my_vector, i, sizeof(T), run);
+		// Segment boundaries do not depend on the vector, so the source run is never shorter
+		__TBB_ASSERT(run >= n, NULL);
+		my_copy(dst, src, n);
+	}
+};
+
+// Element base+i is copied from *(first+i)
+template <typename I>
+class iterator_source : internal::no_assign {
+	const I my_first;
+	const size_type my_base;
+public:
+	iterator_source(const I& first, size_type base) : my_first(first), my_base(base) {}
+	void construct(void* dst, size_type i, size_type n) const {
+		I it = my_first + ptrdiff_t(i - my_base);
+		copy_range<I>(dst, static_cast<const void*>(&it), n);
+	}
+};
+
+// Elements are copied from an input iterator in order, so only the serial path uses it
+template <typename I>
+class input_source : internal::no_assign {
+	mutable I my_it;
+public:
+	input_source(const I& first) : my_it(first) {}
+	void construct(void* dst, size_type, size_type n) const {
+		copy_range<I>(dst, static_cast<const void*>(&my_it), n);
+	}
+};
+
+/*
+ * Constructs chunk [begin,end) run by run
+ *
+ * The array operations zero the rest of a run they fail in; the runs after it are
+ * zeroed here, so a failed chunk ends up as the serial path leaves a failed range.
+ */
+template <typename Source>
+class parallel_construct_body : internal::no_assign {
+	const concurrent_vector& my_vector;
+	const Source& my_source;
+	const size_type my_offset;
+public:
+	parallel_construct_body(const concurrent_vector& v, const Source& source, size_type offset) :
+		my_vector(v), my_source(source), my_offset(offset) {}
+	void operator()(size_type begin, size_type end) const {
+		for (begin += my_offset, end += my_offset; begin < end;) {
+			size_type run;
+			void* dst = internal_element_run(my_vector, begin, sizeof(T), run);
+			if (run > end - begin) run = end - begin;
+			__TBB_TRY {
+				my_source.construct(dst, begin, run);
+			} __TBB_CATCH(...) {
+				for (begin += run; begin < end; begin += run) {
+					dst = internal_element_run(my_vector, begin, sizeof(T), run);
+					if (run > end - begin) run = end - begin;
+					std::memset(dst, 0, run*sizeof(T));
+				}
+				__TBB_RETHROW();
+			}
+			begin += run;
+		}
+	}
+};
+
+/*
+ * Moves chunk [begin,end) of the vector into the new first block
+ *
+ * A chunk either moves completely or leaves nothing constructed behind,
+ * so a failed compaction only has to destroy the chunks marked done.
+ */
+class compact_body : internal::no_assign {
+	const concurrent_vector& my_vector;
+	const pointer my_array;
+	char* const my_done;
+	const size_type my_grainsize;
+public:
+	compact_body(const concurrent_vector& v, pointer array, char* done, size_type grainsize) :
+		my_vector(v), my_array(array), my_done(done), my_grainsize(grainsize) {}
+	void operator()(size_type begin, size_type end) const {
+		size_type i = begin;
+		__TBB_TRY {
+			for (size_type run; i < end;) {
+				T* src = static_cast<T*>(internal_element_run(my_vector, i, sizeof(T), run));
+				if (run > end - i) run = end - i;
+				for (T* last = src + run; src != last; ++src, ++i)
+#if __TBB_MOVE_IF_NOEXCEPT_PRESENT
+					new(&my_array[i]) T(std::move_if_noexcept(*src));
+#else
+					new(&my_array[i]) T(*src);
+#endif
+			}
+		} __TBB_CATCH(...) {
+			for (size_type j = begin; j < i; ++j)
+				my_array[j].~T();
+			__TBB_RETHROW();
+		}
+		my_done[begin/my_grainsize] = 1;
+	}
+};
+
+// Destroys chunk [begin,end) of the vector in place
+class destroy_body : internal::no_assign {
+	const concurrent_vector& my_vector;
+public:
+	destroy_body(const concurrent_vector& v) : my_vector(v) {}
+	void operator()(size_type begin, size_type end) const {
+		for (size_type run; begin < end; begin += run) {
+			void* array = internal_element_run(my_vector, begin, sizeof(T), run);
+			if (run > end - begin) run = end - begin;
+			destroy_array(array, run);
+		}
+	}
+};
+
 static void __TBB_EXPORTED_FUNC initialize_array(void* begin, const void*, size_type n);
+// Leaves the elements raw, for callers that construct them afterwards
+static void __TBB_EXPORTED_FUNC uninitialized_array(void*, const void*, size_type) {}
 static void __TBB_EXPORTED_FUNC initialize_array_by(void* begin, const void*, size_type n);
 static void __TBB_EXPORTED_FUNC copy_array(void* dst, const void* src, size_type n);
 
@@ -989,7 +1432,7 @@ void iterate(I &src) {
 
 ~internal_loop_guide() {
 	if (i < n) {
-		internal::handle_unconstructed_elements(array+1, n-1);
+		internal::handle_unconstructed_elements(array+i, n-i);
 	}
 }
 };
@@ -1013,11 +1456,20 @@ struct push_back_helper : internal::no_copy {
 	push_back_helper(concurrent_vector &vector) :
 		v(vector), g(static_cast<T*>(v.internal_push_back(sizeof(T),k)))
 	{}
+	// A failed element is zeroed before its slot is published
+	~push_back_helper() {
+		if (g.element) {
+			internal::handle_unconstructed_elements(g.element,1);
+			g.dismiss();
+			v.my_publication.publish(k, k+1);
+		}
+	}
 
 	pointer internal_push_back_result() {return g.element;}
 	iterator return_iterator_and_dismiss() {
 		pointer ptr = g.element;
 		g.dismiss();
+		v.my_publication.publish(k, k+1);
 		return iterator(v,k,ptr);
 	}
 };
@@ -1029,7 +1481,12 @@ struct push_back_helper : internal::no_copy {
 #endif
 
 template <typename T, class A>
-void concurrent_vector<T,A>::shrink_to_fit() {
+typename concurrent_vector<T,A>::size_type concurrent_vector<T,A>::shrink_to_fit() {
+	size_type allocated = internal_allocated_bytes(sizeof(T));
+	if (size()*sizeof(T) >= size_type(parallel_construction_threshold)) {
+		internal_parallel_compact();
+		return allocated - internal_allocated_bytes(sizeof(T));
+	}
 	internal_segments_table old;
 	__TBB_TRY {
 		internal_array_op2 copy_or_move_array =
@@ -1046,6 +1503,7 @@ void concurrent_vector<T,A>::shrink_to_fit() {
 			internal_free_segments(old.table, 1, old.first_block);
 		__TBB_RETHROW();
 	}
+	return allocated - internal_allocated_bytes(sizeof(T));
 }
 
 #if defined(_MSC_VER) && !defined(__INTEL_COMPILER)
@@ -1079,7 +1537,7 @@ T& concurrent_vector<T,A>::internal_subscript_with_exceptions(size_type index) c
 }
 
 template <typename T, class A> template <class I>
-void concurrent_vector<T,A>::internal_assign_iterator(I first, I last) {
+void concurrent_vector<T,A>::internal_assign_iterators(I first, I last) {
 	__TBB_ASSERT(my_early_size == 0, NULL);
 	size_type n = std::distance(first,last);
 	if (!n) return;
@@ -1089,7 +1547,7 @@ void concurrent_vector<T,A>::internal_assign_iterator(I first, I last) {
 	size_type sz = segment_size(my_first_block);
 	while (sz < n)
 	{
-		internal_loop_guide_loop(sz,my_segment[k].template load<relaxed>().template pointer<void>());
+		internal_loop_guide loop(sz,my_segment[k].template load<relaxed>().template pointer<void>());
 		loop.iterate(first);
 		n -= sz;
 		if (!k) k = my_first_block;
@@ -1101,6 +1559,143 @@ void concurrent_vector<T,A>::internal_assign_iterator(I first, I last) {
 	}
 	internal_loop_guide loop(n,my_segment[k].template load<relaxed>().template pointer<void>());
 	loop.iterate(first);
+	my_publication.reset(my_early_size);
+}
+
+template <typename T, class A>
+void concurrent_vector<T,A>::internal_parallel_copy(const internal::concurrent_vector_base_v3& src, size_type n, internal_array_op2 copy) {
+	if (n*sizeof(T) < size_type(parallel_construction_threshold)) {
+		internal_copy(src, sizeof(T), copy);
+	} else {
+		__TBB_ASSERT(my_early_size == 0, NULL);
+		internal_reserve(n, sizeof(T), max_size());
+		my_early_size = n;
+		internal_parallel_construct(0, n, vector_source(src, copy));
+	}
+	my_publication.reset(size());
+}
+
+template <typename T, class A>
+void concurrent_vector<T,A>::internal_parallel_assign(const internal::concurrent_vector_base_v3& src, size_type n,
+		                                              internal_array_op2 assign, internal_array_op2 copy) {
+	if (n*sizeof(T) < size_type(parallel_construction_threshold)) {
+		internal_assign(src, sizeof(T), &destroy_array, assign, copy);
+		my_publication.reset(size());
+		return;
+	}
+	// Reusing the existing elements by assignment is serial, so destroy them and copy construct in parallel
+	internal_clear(&destroy_array);
+	internal_parallel_copy(src, n, copy);
+}
+
+template <typename T, class A>
+void concurrent_vector<T,A>::internal_parallel_resize(size_type n, const void* src, internal_array_op2 init) {
+	size_type old_size = size();
+	if (n <= old_size || (n-old_size)*sizeof(T) < size_type(parallel_construction_threshold)) {
+		internal_resize(n, sizeof(T), max_size(), src, &destroy_array, init);
+	} else {
+		internal_resize(n, sizeof(T), max_size(), NULL, &destroy_array, &uninitialized_array);
+		internal_parallel_construct(old_size, n, fill_source(init, src));
+	}
+	my_publication.reset(size());
+}
+
+template <typename T, class A>
+typename concurrent_vector<T,A>::size_type
+concurrent_vector<T,A>::internal_published_grow_by(size_type delta, internal_array_op2 init, const void* src) {
+	size_type base = internal_grow_by(delta, sizeof(T), &uninitialized_array, NULL);
+	internal_published_construct(base, base+delta, fill_source(init, src), true);
+	return base;
+}
+
+template <typename T, class A>
+typename concurrent_vector<T,A>::size_type
+concurrent_vector<T,A>::internal_published_grow_to_at_least(size_type n, internal_array_op2 init, const void* src) {
+	size_type m = internal_grow_to_at_least_with_result(n, sizeof(T), &uninitialized_array, NULL);
+	// The size seen before growing; when it is below n this thread reserved [m,n)
+	if (m < n)
+		internal_published_construct(m, n, fill_source(init, src), true);
+	return m;
+}
+
+template <typename T, class A> template <typename Source>
+void concurrent_vector<T,A>::internal_published_construct(size_type begin, size_type end, const Source& source, bool parallel) {
+	__TBB_TRY {
+		if (parallel && (end-begin)*sizeof(T) >= size_type(parallel_construction_threshold))
+			internal_parallel_construct(begin, end, source);
+		else
+			parallel_construct_body<Source>(*this, source, 0)(begin, end);
+	} __TBB_CATCH(...) {
+		my_publication.publish(begin, end);
+		__TBB_RETHROW();
+	}
+	my_publication.publish(begin, end);
+}
+
+template <typename T, class A> template <typename Source>
+void concurrent_vector<T,A>::internal_parallel_construct(size_type begin, size_type end, const Source& source) {
+	size_type grainsize = size_type(parallel_construction_grainsize)/sizeof(T);
+	internal::parallel_chunk_invoke(end-begin, grainsize ? grainsize : 1,
+			parallel_construct_body<Source>(*this, source, begin));
+}
+
+/*
+ * Compaction that moves and destroys the elements on all hardware threads
+ *
+ * Same result as internal_compact: the segments holding [0,size()) become one
+ * first block, and the segments past it are freed. The old segments are only
+ * released once every element has moved, so a throwing copy constructor leaves
+ * the vector as it was.
+ */
+template <typename T, class A>
+void concurrent_vector<T,A>::internal_parallel_compact() {
+	size_type n = size();
+	__TBB_ASSERT(n, NULL);
+	segment_index_t k_end = segment_index_of(n-1) + 1;
+	segment_index_t first_block = my_first_block;
+	segment_t* table = my_segment.load<relaxed>();
+	if (first_block < k_end) {
+		size_type grainsize = size_type(parallel_construction_grainsize)/sizeof(T);
+		if (!grainsize) grainsize = 1;
+		size_type n_chunks = (n + grainsize - 1)/grainsize;
+		char* done = new char[n_chunks]();
+		pointer array = NULL;
+		__TBB_TRY {
+			array = this->my_allocator.allocate(segment_size(k_end));
+			internal::parallel_chunk_invoke(n, grainsize, compact_body(*this, array, done, grainsize));
+		} __TBB_CATCH(...) {
+			if (array) {
+				for (size_type c = 0; c < n_chunks; ++c) {
+					if (!done[c]) continue;
+					size_type begin = c*grainsize;
+					destroy_array(array + begin, n - begin < grainsize ? n - begin : grainsize);
+				}
+				this->my_allocator.deallocate(array, segment_size(k_end));
+			}
+			delete[] done;
+			__TBB_RETHROW();
+		}
+		delete[] done;
+		internal::parallel_chunk_invoke(n, grainsize, destroy_body(*this));
+		for (segment_index_t k = 0; k < k_end; ++k) {
+			if (k && k < first_block) continue;
+			segment_value_t segment_value = table[k].load<relaxed>();
+			if (segment_value == segment_allocated())
+				this->my_allocator.deallocate(segment_value.template pointer<T>(), segment_size(k ? k : first_block));
+		}
+		for (segment_index_t k = 0; k < k_end; ++k)
+			table[k].store<relaxed>(static_cast<void*>(array + segment_base(k)));
+		my_first_block = k_end;
+		first_block = k_end;
+	}
+	segment_index_t n_segments = table == my_storage ? pointers_per_short_table : pointers_per_long_table;
+	for (segment_index_t k = first_block > k_end ? first_block : k_end; k < n_segments; ++k) {
+		segment_value_t segment_value = table[k].load<relaxed>();
+		if (segment_value == segment_allocated()) {
+			this->my_allocator.deallocate(segment_value.template pointer<T>(), segment_size(k));
+			table[k].store<relaxed>(segment_not_used());
+		}
+	}
 }
 
 template <typename T, class A>
@@ -1208,6 +1803,107 @@ inline void swap (const concurrent_vector<T,A>& a, const concurrent_vector<T,A>&
 {
 	a.swap(b);
 }
+
+/*
+ * Per-thread append buffer for a concurrent_vector
+ *
+ * push_back() constructs elements in a private buffer, and a full buffer is appended
+ * with one grow_by(), so a producer touches the shared size once per chunk instead of
+ * once per element. Buffered elements reach the vector, in order, only when their chunk
+ * is flushed; the destructor flushes what is left. An appender belongs to one thread,
+ * each producer creates its own.
+ */
+template <typename T, class A = cache_aligned_allocator<T> >
+class concurrent_vector_appender : internal::no_copy {
+public:
+	typedef concurrent_vector<T,A> vector_type;
+	typedef typename vector_type::size_type size_type;
+	typedef typename vector_type::iterator iterator;
+	typedef typename vector_type::allocator_type allocator_type;
+
+	// chunk_size elements are appended at a time; 0 picks about a page worth of elements
+	explicit concurrent_vector_appender(vector_type& vector, size_type chunk_size = 0) :
+		my_vector(vector), my_allocator(vector.get_allocator()), my_size(0)
+	{
+		if (!chunk_size)
+			chunk_size = sizeof(T) < size_type(default_chunk_bytes) ? size_type(default_chunk_bytes)/sizeof(T) : 1;
+		my_capacity = chunk_size;
+		my_buffer = my_allocator.allocate(my_capacity);
+	}
+
+	// A flush that throws here loses the buffered elements, see flush()
+	~concurrent_vector_appender() {
+		__TBB_TRY {
+			flush();
+		} __TBB_CATCH(...) {}
+		my_allocator.deallocate(my_buffer, my_capacity);
+	}
+
+	void push_back(const T& item) {
+		if (my_size == my_capacity) flush();
+		new(my_buffer + my_size) T(item);
+		++my_size;
+	}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push_back(T&& item) {
+		if (my_size == my_capacity) flush();
+		new(my_buffer + my_size) T(std::move(item));
+		++my_size;
+	}
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT
+	template <typename... Args>
+	void emplace_back(Args&&... args) {
+		if (my_size == my_capacity) flush();
+		new(my_buffer + my_size) T(std::forward<Args>(args)...);
+		++my_size;
+	}
+#endif
+#endif
+
+	/*
+	 * Append the buffered elements to the vector, returns iterator to the first of them
+	 *
+	 * If growing the vector throws, the buffered elements are lost: part of them may already
+	 * be in the failed range of the vector and the rest moved from, so the buffer is emptied
+	 * rather than kept for a retry that would append them twice.
+	 */
+	iterator flush() {
+		__TBB_TRY {
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+			iterator result = my_vector.grow_by(std::move_iterator<T*>(my_buffer), std::move_iterator<T*>(my_buffer + my_size));
+#else
+			iterator result = my_vector.grow_by(my_buffer, my_buffer + my_size);
+#endif
+			internal_destroy();
+			return result;
+		} __TBB_CATCH(...) {
+			internal_destroy();
+			__TBB_RETHROW();
+		}
+	}
+
+	// Number of elements waiting for the next flush
+	size_type buffered() const {return my_size;}
+
+	vector_type& vector() const {return my_vector;}
+
+private:
+	enum {
+		default_chunk_bytes = 4096
+	};
+
+	vector_type& my_vector;
+	allocator_type my_allocator;
+	T* my_buffer;
+	size_type my_capacity;
+	size_type my_size;
+
+	void internal_destroy() {
+		for (; my_size > 0; --my_size)
+			my_buffer[my_size-1].~T();
+	}
+};
 }
 
 #endif /* INCLUDE_TBB_CONCURRENT_VECTOR_H_ */
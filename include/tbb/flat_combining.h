@@ -0,0 +1,459 @@
+/*
+ * flat_combining.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_FLAT_COMBINING_H_
+#define INCLUDE_TBB_FLAT_COMBINING_H_
+
+#if !TBB_PREVIEW_AGGREGATOR
+#error Set TBB_PREVIEW_AGGREGATOR before including flat_combining.h, its containers are built on the aggregator
+#endif
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "atomic.h"
+#include "aggregator.h"
+#include "cache_aligned_allocator.h"
+#include "internal/_tbb_hash_compare_impl.h"
+#include <vector>
+#include <algorithm>
+#include <new>
+
+/*
+ * Flat-combining containers
+ *
+ * Each container is a sequential data structure behind an aggregator_ext: threads queue
+ * their operation and one of them applies the whole batch, with a handler that uses the
+ * batch as a whole instead of running it operation by operation. See
+ * concurrent_priority_queue for the priority queue of this kind.
+ */
+
+namespace tbb {
+
+namespace internal {
+
+// Request to the handler of a flat_combining_stack
+template <typename T>
+class fc_stack_operation : public aggregator_operation {
+public:
+	enum operation_type {push_op, push_rvalue_op, pop_op};
+	const operation_type type;
+	T* const elem;
+	// Set by the handler: the push was stored, or the pop found an item
+	bool success;
+	fc_stack_operation(operation_type t, T* e) : type(t), elem(e), success(false) {}
+};
+
+// Request to the handler of a flat_combining_set; the calling thread hashes the key
+template <typename Key>
+class fc_set_operation : public aggregator_operation {
+public:
+	enum operation_type {insert_op, erase_op, find_op};
+	const operation_type type;
+	const Key* const key;
+	// Hash of the key with the low bit set, so that 0 can mark an empty slot
+	const size_t tag;
+	// Set by the handler: the key was inserted, erased or found
+	bool success;
+	// Set by the handler: an insert could not store the key
+	bool failed;
+	fc_set_operation(operation_type t, const Key* k, size_t h) : type(t), key(k), tag(h | 1), success(false), failed(false) {}
+};
+
+}
+
+/*
+ * Concurrent LIFO stack by flat combining
+ *
+ * The handler pairs off the pushes and pops of a batch first: a pop takes the item of
+ * a push straight from the pushing thread, as if the push had run just before it, and
+ * neither touches the stack. Only the operations left over reach the vector behind the
+ * stack, and under balanced load most of them never do. Every operation is serialized
+ * through the aggregator, so per-operation cost is a queued request, not a lock.
+ */
+template <typename T, typename A = cache_aligned_allocator<T> >
+class flat_combining_stack : internal::no_copy {
+	typedef internal::fc_stack_operation<T> operation;
+
+	class handler {
+		flat_combining_stack* my_stack;
+	public:
+		handler(flat_combining_stack* s) : my_stack(s) {}
+		void operator()(aggregator_operation* op_list) const {my_stack->handle_operations(op_list);}
+	};
+
+	aggregator_ext<handler> my_aggregator;
+	// Number of items after the last batch; read without going through the aggregator
+	atomic<size_t> my_size;
+	char pad[internal::NFS_MaxLineSize - sizeof(atomic<size_t>)];
+	std::vector<T, A> my_data;
+
+	void handle_operations(aggregator_operation* op_list) {
+		// Operations no partner was found for, oldest first
+		operation* push_list = NULL;
+		operation* pop_list = NULL;
+		while (op_list) {
+			operation* op = static_cast<operation*>(op_list);
+			op_list = op_list->next();
+			op->start();
+			if (op->type == operation::pop_op) {
+				if (push_list && eliminate_head(push_list, op))
+					continue;
+				op->set_next(pop_list);
+				pop_list = op;
+			} else {
+				if (pop_list && eliminate_head(pop_list, op))
+					continue;
+				op->set_next(push_list);
+				push_list = op;
+			}
+		}
+		// The rest go to the stack, pushes first so that the pops may take their items
+		while (push_list) {
+			operation* op = push_list;
+			push_list = static_cast<operation*>(push_list->next());
+			__TBB_TRY {
+				if (op->type == operation::push_op)
+					my_data.push_back(*op->elem);
+				else
+					my_data.push_back(tbb::internal::move(*op->elem));
+				op->success = true;
+			} __TBB_CATCH(...) {
+				op->success = false;
+			}
+			op->finish();
+		}
+		while (pop_list) {
+			operation* op = pop_list;
+			pop_list = static_cast<operation*>(pop_list->next());
+			if (my_data.empty()) {
+				op->success = false;
+			} else {
+				*op->elem = tbb::internal::move(my_data.back());
+				my_data.pop_back();
+				op->success = true;
+			}
+			op->finish();
+		}
+		my_size = my_data.size();
+	}
+
+	// Hand the item of push to pop and finish both; false, with neither finished, if the item could not be copied
+	bool eliminate(operation* push, operation* pop) {
+		__TBB_TRY {
+			if (push->type == operation::push_op)
+				*pop->elem = *push->elem;
+			else
+				*pop->elem = tbb::internal::move(*push->elem);
+		} __TBB_CATCH(...) {
+			return false;
+		}
+		push->success = pop->success = true;
+		push->finish();
+		pop->finish();
+		return true;
+	}
+
+	// Pair op with the head of the list of its unmatched partners, unlinking the head if that worked
+	bool eliminate_head(operation*& list, operation* op) {
+		operation* head = list;
+		list = static_cast<operation*>(head->next());
+		bool pushed = op->type != operation::pop_op;
+		if (pushed ? eliminate(op, head) : eliminate(head, op))
+			return true;
+		head->set_next(list);
+		list = head;
+		return false;
+	}
+
+	void execute(operation& op) {
+		my_aggregator.process(&op);
+		if (!op.success && op.type != operation::pop_op)
+			internal::throw_exception(internal::eid_bad_alloc);
+	}
+
+public:
+	typedef T value_type;
+	typedef T& reference;
+	typedef const T& const_reference;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit flat_combining_stack(const allocator_type& a = allocator_type()) :
+		my_aggregator(handler(this)), my_data(a) {
+		my_size = 0;
+	}
+
+	void push(const T& item) {
+		operation op(operation::push_op, const_cast<T*>(&item));
+		execute(op);
+	}
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+	void push(T&& item) {
+		operation op(operation::push_rvalue_op, &item);
+		execute(op);
+	}
+#endif
+
+	// Move the most recently pushed item into result; false if the stack was empty
+	bool try_pop(T& result) {
+		operation op(operation::pop_op, &result);
+		execute(op);
+		return op.success;
+	}
+
+	// Number of items as of the last batch of operations
+	size_type size() const {return my_size;}
+
+	bool empty() const {return size() == 0;}
+
+	// Remove all items; not thread-safe
+	void clear() {
+		my_data.clear();
+		my_size = 0;
+	}
+
+	allocator_type get_allocator() const {return my_data.get_allocator();}
+};
+
+/*
+ * Concurrent hash set by flat combining
+ *
+ * Behind the aggregator is a sequential open addressing table with linear probing, which
+ * is kept at most half full. Keys are hashed by the calling threads, in parallel, before
+ * their operation is queued. The handler then makes room for all inserts of the batch at
+ * once and applies the batch in the order of the home slots of its keys, so that a batch
+ * sweeps the table once instead of jumping around in it.
+ */
+template <typename Key, typename HashCompare = tbb_hash_compare<Key>, typename A = cache_aligned_allocator<Key> >
+class flat_combining_set : internal::no_copy {
+	typedef internal::fc_set_operation<Key> operation;
+	static const size_t min_capacity = 16;
+
+	class handler {
+		flat_combining_set* my_set;
+	public:
+		handler(flat_combining_set* s) : my_set(s) {}
+		void operator()(aggregator_operation* op_list) const {my_set->handle_operations(op_list);}
+	};
+
+	// Orders operations by the home slot of their key
+	class slot_order {
+		const flat_combining_set& my_set;
+	public:
+		slot_order(const flat_combining_set& s) : my_set(s) {}
+		bool operator()(const operation* a, const operation* b) const {return my_set.home(a->tag) < my_set.home(b->tag);}
+	};
+
+	aggregator_ext<handler> my_aggregator;
+	// Number of keys after the last batch; read without going through the aggregator
+	atomic<size_t> my_size;
+	char pad[internal::NFS_MaxLineSize - sizeof(atomic<size_t>)];
+	HashCompare my_hash_compare;
+	A my_allocator;
+	// my_keys[i] holds a key iff my_tags[i] != 0
+	Key* my_keys;
+	std::vector<size_t> my_tags;
+	size_t my_count;
+	// The home slot of a tag is the top bits of its Fibonacci hash
+	unsigned my_shift;
+	// Operations of the current batch, kept to reuse its memory
+	std::vector<operation*> my_batch;
+
+	size_t capacity() const {return my_tags.size();}
+
+	size_t home(size_t tag) const {return (tag*interface5::internal::hash_multiplier) >> my_shift;}
+
+	// Slot of the key, or capacity() if it is not in the table
+	size_t find(const Key& key, size_t tag) const {
+		const size_t mask = capacity() - 1;
+		if (!my_count)
+			return capacity();
+		for (size_t i = home(tag);; i = (i + 1) & mask) {
+			if (!my_tags[i])
+				return capacity();
+			if (my_tags[i] == tag && my_hash_compare.equal(my_keys[i], key))
+				return i;
+		}
+	}
+
+	// Store a key that is not in the table; there must be room for it
+	void place(const Key& key, size_t tag) {
+		const size_t mask = capacity() - 1;
+		size_t i = home(tag);
+		while (my_tags[i])
+			i = (i + 1) & mask;
+		new (&my_keys[i]) Key(key);
+		my_tags[i] = tag;
+		++my_count;
+	}
+
+	// Remove the key in slot i, shifting back the keys of its probe sequence that may move up
+	void remove(size_t i) {
+		const size_t mask = capacity() - 1;
+		my_keys[i].~Key();
+		for (size_t j = (i + 1) & mask; my_tags[j]; j = (j + 1) & mask) {
+			if (((j - home(my_tags[j])) & mask) < ((j - i) & mask))
+				continue;
+			new (&my_keys[i]) Key(tbb::internal::move(my_keys[j]));
+			my_keys[j].~Key();
+			my_tags[i] = my_tags[j];
+			i = j;
+		}
+		my_tags[i] = 0;
+		--my_count;
+	}
+
+	// Grow the table until n keys fill at most half of it
+	void reserve(size_t n) {
+		size_t new_capacity = capacity() ? capacity() : size_t(min_capacity);
+		while (new_capacity < 2*n)
+			new_capacity *= 2;
+		if (new_capacity == capacity())
+			return;
+		std::vector<size_t> tags(new_capacity, 0);
+		Key* keys = my_allocator.allocate(new_capacity);
+		unsigned shift = 8*sizeof(size_t);
+		for (size_t c = new_capacity; c > 1; c >>= 1)
+			--shift;
+		Key* old_keys = my_keys;
+		size_t old_capacity = capacity();
+		my_tags.swap(tags);
+		my_keys = keys;
+		my_shift = shift;
+		my_count = 0;
+		for (size_t i = 0; i < old_capacity; ++i) {
+			if (tags[i]) {
+				const size_t mask = new_capacity - 1;
+				size_t j = home(tags[i]);
+				while (my_tags[j])
+					j = (j + 1) & mask;
+				new (&my_keys[j]) Key(tbb::internal::move(old_keys[i]));
+				old_keys[i].~Key();
+				my_tags[j] = tags[i];
+				++my_count;
+			}
+		}
+		if (old_keys)
+			my_allocator.deallocate(old_keys, old_capacity);
+	}
+
+	void apply(operation& op) {
+		op.start();
+		size_t i = find(*op.key, op.tag);
+		switch (op.type) {
+		case operation::find_op:
+			op.success = i != capacity();
+			break;
+		case operation::erase_op:
+			op.success = i != capacity();
+			if (op.success)
+				remove(i);
+			break;
+		case operation::insert_op:
+			if (i != capacity())
+				break;
+			__TBB_TRY {
+				reserve(my_count + 1);
+				place(*op.key, op.tag);
+				op.success = true;
+			} __TBB_CATCH(...) {
+				op.failed = true;
+			}
+			break;
+		}
+		op.finish();
+	}
+
+	void handle_operations(aggregator_operation* op_list) {
+		size_t inserts = 0;
+		for (aggregator_operation* p = op_list; p; p = p->next())
+			if (static_cast<operation*>(p)->type == operation::insert_op)
+				++inserts;
+		bool sorted = false;
+		__TBB_TRY {
+			// Room for every insert, so that the order of the batch stays that of the table
+			reserve(my_count + inserts);
+			my_batch.clear();
+			for (aggregator_operation* p = op_list; p; p = p->next())
+				my_batch.push_back(static_cast<operation*>(p));
+			std::sort(my_batch.begin(), my_batch.end(), slot_order(*this));
+			sorted = true;
+		} __TBB_CATCH(...) {
+			// Out of memory: apply the batch as it came, each insert growing the table itself
+		}
+		if (sorted) {
+			for (size_t i = 0; i < my_batch.size(); ++i)
+				apply(*my_batch[i]);
+		} else {
+			while (op_list) {
+				operation* op = static_cast<operation*>(op_list);
+				op_list = op_list->next();
+				apply(*op);
+			}
+		}
+		my_size = my_count;
+	}
+
+	bool execute(typename operation::operation_type type, const Key& key) {
+		operation op(type, &key, my_hash_compare.hash(key));
+		my_aggregator.process(&op);
+		if (op.failed)
+			internal::throw_exception(internal::eid_bad_alloc);
+		return op.success;
+	}
+
+public:
+	typedef Key key_type;
+	typedef Key value_type;
+	typedef size_t size_type;
+	typedef ptrdiff_t difference_type;
+	typedef A allocator_type;
+
+	explicit flat_combining_set(const HashCompare& hash_compare = HashCompare(), const allocator_type& a = allocator_type()) :
+		my_aggregator(handler(this)), my_hash_compare(hash_compare), my_allocator(a),
+		my_keys(NULL), my_count(0), my_shift(8*sizeof(size_t)) {
+		my_size = 0;
+	}
+
+	~flat_combining_set() {
+		clear();
+		if (my_keys)
+			my_allocator.deallocate(my_keys, capacity());
+	}
+
+	// False if the key was in the set already
+	bool insert(const Key& key) {return execute(operation::insert_op, key);}
+
+	// False if the key was not in the set
+	bool erase(const Key& key) {return execute(operation::erase_op, key);}
+
+	bool contains(const Key& key) {return execute(operation::find_op, key);}
+
+	// Number of keys as of the last batch of operations
+	size_type size() const {return my_size;}
+
+	bool empty() const {return size() == 0;}
+
+	// Remove all keys; not thread-safe
+	void clear() {
+		for (size_t i = 0; i < capacity(); ++i) {
+			if (my_tags[i]) {
+				my_keys[i].~Key();
+				my_tags[i] = 0;
+			}
+		}
+		my_count = 0;
+		my_size = 0;
+	}
+
+	allocator_type get_allocator() const {return my_allocator;}
+};
+
+}
+
+#endif /* INCLUDE_TBB_FLAT_COMBINING_H_ */
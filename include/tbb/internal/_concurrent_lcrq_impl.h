@@ -0,0 +1,428 @@
+/*
+ * _concurrent_lcrq_impl.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_INTERNAL__CONCURRENT_LCRQ_IMPL_H_
+#define INCLUDE_TBB_INTERNAL__CONCURRENT_LCRQ_IMPL_H_
+
+#include "_concurrent_queue_impl.h"
+
+#if __TBB_CAS16_PRESENT
+
+namespace tbb {
+namespace strict_ppl {
+namespace internal {
+
+// Cell of an lcrq_ring: the ticket it is ready for (top bit set when unsafe) and an item pointer or 0
+struct lcrq_cell {
+	volatile uint64_t idx;
+	volatile uint64_t val;
+};
+
+/*
+ * Bounded ring of lcrq_queue_base, the CRQ of Morrison and Afek's LCRQ
+ *
+ * Producers and consumers take tickets with a fetch-and-add on tail and head and
+ * meet in cell ticket%size, which a 16 byte CAS updates together with the ticket the
+ * cell is ready for. A consumer that overtakes its producer moves the cell on to the
+ * next lap, so the producer has to take another ticket. A producer that finds the ring
+ * full, or keeps losing its cells that way, closes the ring with the top bit of tail,
+ * and the queue continues in a new ring.
+ */
+struct lcrq_ring {
+	static const ticket closed = ticket(1) << (8*sizeof(ticket)-1);
+	static const uint64_t unsafe = uint64_t(1) << 63;
+	// Tickets a producer tries before it closes the ring
+	static const int max_enqueue_tries = 16;
+
+	atomic<ticket> head;
+	char pad1[NFS_MaxLineSize-sizeof(atomic<ticket>)];
+	atomic<ticket> tail;
+	char pad2[NFS_MaxLineSize-sizeof(atomic<ticket>)];
+	atomic<lcrq_ring*> next;
+	lcrq_ring* next_retired;
+	size_t size;
+	char pad3[NFS_MaxLineSize-sizeof(atomic<lcrq_ring*>)-sizeof(lcrq_ring*)-sizeof(size_t)];
+	lcrq_cell cells[1];
+
+	static size_t allocation_size(size_t size) {
+		return sizeof(lcrq_ring) + (size-1)*sizeof(lcrq_cell);
+	}
+
+	// Empty ring of size cells, or one holding first at ticket 0
+	void init(size_t n, void* first) {
+		size = n;
+		for (size_t i = 0; i < n; ++i) {
+			cells[i].idx = i;
+			cells[i].val = 0;
+		}
+		cells[0].val = uint64_t(uintptr_t(first));
+		next_retired = NULL;
+		next = NULL;
+		head = 0;
+		tail = first ? 1 : 0;
+	}
+
+	static bool cas_cell(lcrq_cell& c, uint64_t idx, uint64_t val, uint64_t new_idx, uint64_t new_val) {
+		int64_t comparand[2] = {int64_t(idx), int64_t(val)};
+		const int64_t value[2] = {int64_t(new_idx), int64_t(new_val)};
+		return __TBB_machine_cmpswp16(&c, value, comparand);
+	}
+
+	// False if the ring is closed
+	bool enqueue(void* item) {
+		for (int tries = 0;; ++tries) {
+			ticket t = tail.fetch_and_increment();
+			if (t & closed)
+				return false;
+			lcrq_cell& c = cells[t & (size-1)];
+			uint64_t idx = __TBB_load_with_acquire(c.idx);
+			uint64_t val = __TBB_load_with_acquire(c.val);
+			if (!val && (idx & ~unsafe) <= t && (!(idx & unsafe) || head <= t)
+				&& cas_cell(c, idx, 0, t, uint64_t(uintptr_t(item))))
+				return true;
+			if ((ptrdiff_t)(t - head) >= (ptrdiff_t)size || tries >= max_enqueue_tries) {
+				__TBB_AtomicOR(&tail, closed);
+				return false;
+			}
+		}
+	}
+
+	// NULL if the ring is empty
+	void* dequeue() {
+		for (;;) {
+			ticket h = head.fetch_and_increment();
+			lcrq_cell& c = cells[h & (size-1)];
+			for (;;) {
+				uint64_t idx = __TBB_load_with_acquire(c.idx);
+				uint64_t val = __TBB_load_with_acquire(c.val);
+				if ((idx & ~unsafe) > h)
+					break;
+				if (val) {
+					if ((idx & ~unsafe) == h) {
+						if (cas_cell(c, idx, val, (idx & unsafe) | (h + size), 0))
+							return reinterpret_cast<void*>(uintptr_t(val));
+					} else if (cas_cell(c, idx, val, idx | unsafe, val)) {
+						// The producer of an earlier lap still has to collect it
+						break;
+					}
+				} else if (cas_cell(c, idx, 0, (idx & unsafe) | (h + size), 0)) {
+					// Its producer has not come yet and now has to take another ticket
+					break;
+				}
+			}
+			ticket t = tail & ~closed;
+			if (t <= h+1) {
+				fix_state();
+				return NULL;
+			}
+		}
+	}
+
+	// Pull tail up to head after dequeues overshot it; a closed ring is left alone
+	void fix_state() {
+		for (;;) {
+			ticket t = tail;
+			ticket h = head;
+			if (tail != t) continue;
+			if (h <= t) return;
+			if (tail.compare_and_swap(h, t) == t) return;
+		}
+	}
+
+	// Items in the ring, not reliable while it is modified
+	size_t unsafe_size() const {
+		ticket t = tail & ~closed;
+		ticket h = head;
+		return t <= h ? 0 : t-h < size ? size_t(t-h) : size;
+	}
+};
+
+/*
+ * Lock-free unbounded queue on a linked list of lcrq_rings (LCRQ)
+ *
+ * Items live in blocks of their own and the rings pass pointers to them, so every
+ * push allocates. Rings the head has left are retired and freed once no operation
+ * holds them in a hazard pointer. An operation claims one of the queue's hazard
+ * records, normally the one its thread used last; records are only freed with the
+ * queue. The allocator must return 16 byte aligned blocks.
+ */
+template <typename T>
+class lcrq_queue_base : no_copy
+{
+	typedef typename micro_queue<T>::item_constructor_t item_constructor_t;
+	typedef typename micro_queue<T>::item_mover_t item_mover_t;
+
+	// Rings retired before they are checked against the hazard pointers
+	static const size_t retire_threshold = 2;
+
+	struct hazard_record {
+		atomic<lcrq_ring*> ring;
+		atomic<int> busy;
+		hazard_record* next;
+		char pad[NFS_MaxLineSize-sizeof(atomic<lcrq_ring*>)-sizeof(atomic<int>)-sizeof(hazard_record*)];
+	};
+
+	// Owns a hazard record for the duration of an operation
+	class hazard_guard : no_copy {
+		hazard_record* my_record;
+	public:
+		hazard_guard(lcrq_queue_base& q) : my_record(q.acquire_hazard()) {}
+		~hazard_guard() {
+			my_record->ring = NULL;
+			my_record->busy = 0;
+		}
+		// The ring src points to, published as hazard before it is used
+		lcrq_ring* protect(atomic<lcrq_ring*>& src) {
+			lcrq_ring* r = src;
+			for (;;) {
+				// The exchange is a full fence, the reload cannot pass the publication
+				my_record->ring.fetch_and_store(r);
+				lcrq_ring* again = src;
+				if (again == r) return r;
+				r = again;
+			}
+		}
+		void clear() {my_record->ring = NULL;}
+	};
+
+	atomic<lcrq_ring*> my_head;
+	char pad1[NFS_MaxLineSize-sizeof(atomic<lcrq_ring*>)];
+	atomic<lcrq_ring*> my_tail;
+	char pad2[NFS_MaxLineSize-sizeof(atomic<lcrq_ring*>)];
+
+	atomic<hazard_record*> my_hazards;
+	// Key of the hazard record a thread used last
+	const size_t my_id;
+	const size_t my_ring_size;
+	// Spare rings for the next ring change
+	page_pool<lcrq_ring> my_free_rings;
+	spin_mutex my_retired_mutex;
+	lcrq_ring* my_retired;
+	size_t my_n_retired;
+
+	static size_t next_queue_id() {
+		static atomic<size_t> counter;
+		return ++counter;
+	}
+
+	hazard_record* acquire_hazard() {
+#if __TBB_CPP11_PRESENT
+		static thread_local size_t hint_id = 0;
+		static thread_local hazard_record* hint = NULL;
+		if (hint_id == my_id && hint->busy.compare_and_swap(1, 0) == 0)
+			return hint;
+#endif
+		hazard_record* h = my_hazards;
+		for (; h; h = h->next)
+			if (!h->busy && h->busy.compare_and_swap(1, 0) == 0)
+				break;
+		if (!h) {
+			h = static_cast<hazard_record*>(allocate_block(sizeof(hazard_record)));
+			h->ring = NULL;
+			h->busy = 1;
+			hazard_record* first = my_hazards;
+			for (;;) {
+				h->next = first;
+				hazard_record* seen = my_hazards.compare_and_swap(h, first);
+				if (seen == first) break;
+				first = seen;
+			}
+		}
+#if __TBB_CPP11_PRESENT
+		hint_id = my_id;
+		hint = h;
+#endif
+		return h;
+	}
+
+	bool is_hazard(const lcrq_ring* r) const {
+		for (hazard_record* h = my_hazards; h; h = h->next)
+			if (h->ring == r) return true;
+		return false;
+	}
+
+	lcrq_ring* allocate_ring(void* first) {
+		lcrq_ring* r = my_free_rings.take();
+		if (!r) {
+			r = static_cast<lcrq_ring*>(allocate_block(lcrq_ring::allocation_size(my_ring_size)));
+			__TBB_ASSERT(uintptr_t(r->cells) % 16 == 0, "the cells of a ring must be 16 byte aligned");
+		}
+		r->init(my_ring_size, first);
+		return r;
+	}
+
+	void release_ring(lcrq_ring* r) {
+		if (!my_free_rings.put(r))
+			deallocate_block(r, lcrq_ring::allocation_size(my_ring_size));
+	}
+
+	// r is no longer reachable from my_head or my_tail; free it once no hazard pointer holds it
+	void retire(lcrq_ring* r) {
+		lcrq_ring* unused = NULL;
+		{
+			spin_mutex::scoped_lock lock(my_retired_mutex);
+			r->next_retired = my_retired;
+			my_retired = r;
+			if (++my_n_retired < retire_threshold) return;
+			for (lcrq_ring** link = &my_retired; lcrq_ring* p = *link;) {
+				if (is_hazard(p)) {
+					link = &p->next_retired;
+				} else {
+					*link = p->next_retired;
+					p->next_retired = unused;
+					unused = p;
+					--my_n_retired;
+				}
+			}
+		}
+		while (unused) {
+			lcrq_ring* next = unused->next_retired;
+			release_ring(unused);
+			unused = next;
+		}
+	}
+
+	void enqueue(void* item) {
+		hazard_guard guard(*this);
+		for (;;) {
+			lcrq_ring* r = guard.protect(my_tail);
+			if (lcrq_ring* next = r->next) {
+				my_tail.compare_and_swap(next, r);
+				continue;
+			}
+			if (r->enqueue(item)) return;
+			lcrq_ring* fresh = allocate_ring(item);
+			if (r->next.compare_and_swap(fresh, NULL) == NULL) {
+				my_tail.compare_and_swap(fresh, r);
+				return;
+			}
+			release_ring(fresh);
+		}
+	}
+
+	void* dequeue() {
+		hazard_guard guard(*this);
+		for (;;) {
+			lcrq_ring* r = guard.protect(my_head);
+			if (void* item = r->dequeue()) return item;
+			lcrq_ring* next = r->next;
+			if (!next) return NULL;
+			// A push may have landed in r before it was closed
+			if (void* item = r->dequeue()) return item;
+			if (my_head.compare_and_swap(next, r) == r) {
+				my_tail.compare_and_swap(next, r);
+				guard.clear();
+				retire(r);
+			}
+		}
+	}
+
+	// Custom allocator
+	virtual void* allocate_block(size_t n) = 0;
+
+	// Custom de-allocator
+	virtual void deallocate_block(void* p, size_t n) = 0;
+
+protected:
+	// Rings of ring_size cells, rounded up to a power of two; zero picks 1024
+	lcrq_queue_base(size_t ring_size = 0) :
+		my_id(next_queue_id()),
+		my_ring_size(ring_size ? concurrent_queue_rep_base::round_to_power_of_two(ring_size, 2, ~size_t(0)/2+1) : 1024)
+	{
+		my_head = NULL;
+		my_tail = NULL;
+		my_hazards = NULL;
+		my_free_rings.init();
+		my_retired = NULL;
+		my_n_retired = 0;
+	}
+
+	virtual ~lcrq_queue_base() {}
+
+	// Allocate the first ring; called by the derived constructor, which owns the allocator
+	void internal_init() {
+		lcrq_ring* r = allocate_ring(NULL);
+		my_head = r;
+		my_tail = r;
+	}
+
+	// Free the rings once the queue is empty; called by the derived destructor
+	void internal_finish_clear() {
+		for (lcrq_ring* r = my_head; r;) {
+			lcrq_ring* next = r->next;
+			deallocate_block(r, lcrq_ring::allocation_size(my_ring_size));
+			r = next;
+		}
+		my_head = my_tail = NULL;
+		for (lcrq_ring* r = my_retired; r;) {
+			lcrq_ring* next = r->next_retired;
+			deallocate_block(r, lcrq_ring::allocation_size(my_ring_size));
+			r = next;
+		}
+		my_retired = NULL;
+		while (lcrq_ring* r = my_free_rings.take())
+			deallocate_block(r, lcrq_ring::allocation_size(my_ring_size));
+		for (hazard_record* h = my_hazards; h;) {
+			hazard_record* next = h->next;
+			deallocate_block(h, sizeof(hazard_record));
+			h = next;
+		}
+		my_hazards = NULL;
+	}
+
+	void internal_push(const void* src, item_constructor_t construct_item) {
+		T* item = static_cast<T*>(allocate_block(sizeof(T)));
+		__TBB_TRY {
+			construct_item(item, src);
+		} __TBB_CATCH(...) {
+			deallocate_block(item, sizeof(T));
+			__TBB_RETHROW();
+		}
+		__TBB_TRY {
+			enqueue(item);
+		} __TBB_CATCH(...) {
+			item->~T();
+			deallocate_block(item, sizeof(T));
+			__TBB_RETHROW();
+		}
+	}
+
+	bool internal_try_pop(void* dst, item_mover_t move_item = move_assign_popped_item<T>) {
+		T* item = static_cast<T*>(dequeue());
+		if (!item) return false;
+		__TBB_TRY {
+			move_and_destroy_item(dst, *item, move_item);
+		} __TBB_CATCH(...) {
+			deallocate_block(item, sizeof(T));
+			__TBB_RETHROW();
+		}
+		deallocate_block(item, sizeof(T));
+		return true;
+	}
+
+	// Approximate while the queue is modified
+	bool internal_empty() const {
+		hazard_guard guard(*const_cast<lcrq_queue_base*>(this));
+		lcrq_ring* r = guard.protect(const_cast<lcrq_queue_base*>(this)->my_head);
+		return !r->unsafe_size() && !r->next;
+	}
+
+	// Items in the queue; not thread-safe
+	size_t internal_size() const {
+		size_t n = 0;
+		for (const lcrq_ring* r = my_head; r; r = r->next)
+			n += r->unsafe_size();
+		return n;
+	}
+};
+
+}
+}
+}
+
+#endif /* __TBB_CAS16_PRESENT */
+
+#endif /* INCLUDE_TBB_INTERNAL__CONCURRENT_LCRQ_IMPL_H_ */
@@ -17,18 +17,54 @@
 #include "cache_aligned_allocator.h"
 #include "tbb_exception.h"
 #include "tbb_profiling.h"
+#include "internal/_futex_impl.h"
+#include "internal/_latency_histogram_impl.h"
+#include "internal/_template_helper.h"
 #include <new>
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+#include <tuple>
+#endif
+#if __TBB_CPP17_OPTIONAL_PRESENT
+#include <optional>
+#endif
 #include __TBB_STD_SWAP_HEADER
 #include <iterator>
+#include <cstring>
 
 namespace tbb 
 {
+    // Concurrency policies of concurrent_queue: who may push and pop at the same time
+    struct queue_mpmc {};   // any number of producers and consumers
+    struct queue_mpsc {};   // any number of producers, one consumer thread
+    struct queue_spsc {};   // one producer thread, one consumer thread
+    struct queue_lcrq {};   // any number of producers and consumers, lock-free rings; needs __TBB_CAS16_PRESENT
+
+    // Instrumentation policies of the micro_queue based queues (queue_mpmc and concurrent_bounded_queue)
+    struct queue_plain {};          // no statistics beyond the size
+    struct queue_instrumented {};   // high-water mark and enqueue-to-dequeue latencies as well
+
+    // Occupancy and latency of a queue, see concurrent_queue::statistics()
+    struct queue_statistics
+    {
+        static const size_t latency_buckets = internal::latency_histogram::buckets;
+        // tail_counter - head_counter: tickets pushed or being pushed and not yet popped
+        size_t size;
+        // Largest size a push has seen; queue_instrumented only
+        size_t high_water_mark;
+        // Tickets of failed pushes that no pop has skipped yet
+        size_t invalid_entries;
+        // Items popped, the sum of the latency buckets; queue_instrumented only
+        size_t items_popped;
+        // Bucket i counts items that stayed [2^i, 2^(i+1)) ns in the queue; the first and last buckets are open ended
+        size_t latency_histogram[latency_buckets];
+    };
+
     #if !__TBB_TEMPLATE_FRIENDS_BROKEN
     namespace strict_ppl 
     {
-        template <typename T, typename A> class concurrent_queue;
+        template <typename T, typename A, typename Policy, typename Instrumentation> class concurrent_queue;
     }
-    template <typename T, typename A> class concurrent_bounded_queue;
+    template <typename T, typename A, typename Instrumentation> class concurrent_bounded_queue;
     #endif
 
     namespace strict_ppl
@@ -42,18 +78,59 @@ namespace tbb
             template <typename T> class micro_queue_pop_finalizer;
             template <typename T> class concurrent_queue_base_v3;
             template <typename T> struct concurrent_queue_rep;
+            template <typename T> class concurrent_bounded_queue_base;
+
+            /*
+             * Counters of a queue_instrumented queue
+             *
+             * Pushes stamp each item with tick_count::now() in a slot behind the items of its
+             * page, pops add the time since then to a histogram over powers of two nanoseconds.
+             * The counters are shared atomics, so an instrumented queue pays two clock reads
+             * per item and an atomic add per pop. Allocated raw, init() zeroes it.
+             */
+            class queue_instrumentation : no_copy
+            {
+                atomic<size_t> my_high_water_mark;
+                latency_histogram my_latencies;
+
+                public:
+                    void init()
+                    {
+                        my_high_water_mark = 0;
+                        my_latencies.init();
+                    }
+
+                    // A push took the queue to size items
+                    void record_size(ptrdiff_t size)
+                    {
+                        for (size_t h = my_high_water_mark; size > 0 && size_t(size) > h;)
+                        {
+                            size_t seen = my_high_water_mark.compare_and_swap(size_t(size), h);
+                            if (seen == h) break;
+                            h = seen;
+                        }
+                    }
+
+                    // An item stamped at enqueued was popped
+                    void record_latency(const tick_count& enqueued)
+                    {
+                        my_latencies.record(enqueued);
+                    }
+
+                    void fill(queue_statistics& s) const
+                    {
+                        s.high_water_mark = my_high_water_mark;
+                        s.items_popped = my_latencies.copy_to(s.latency_histogram);
+                    }
+            };
 
             struct concurrent_queue_rep_base : no_copy 
             {
                 template <typename T> friend class micro_queue;
                 template <typename T> friend class concurrent_queue_base_v3;
 
-                protected: 
-                // Approximately n_queue/golden ratio
-                static const size_t phi = 3;
-
                 public: 
-                static const size_t n_queue = 8;
+                static const size_t default_n_queue = 8;
                 struct page 
                 {
                     page* next;
@@ -65,11 +142,36 @@ namespace tbb
                 atomic<ticket> tail_counter;
                 char pad2[NFS_MaxLineSize-sizeof(atomic<ticket>)];
 
+                // Number of micro_queues, a power of two
+                size_t n_queue;
+                // Approximately n_queue/golden ratio squared, odd so that tickets cycle through all micro_queues
+                size_t phi;
                 size_t items_per_page;
                 size_t item_size;
 
                 atomic<size_t> n_invalid_entries;
-                char pad3[NFS_MaxLineSize-sizeof(size_t)-sizeof(size_t)-sizeof(atomic<size_t>)];
+                // Counters of a queue_instrumented queue, NULL otherwise
+                queue_instrumentation* instrumentation;
+                char pad3[NFS_MaxLineSize-4*sizeof(size_t)-sizeof(atomic<size_t>)-sizeof(queue_instrumentation*)];
+
+                // Items per page for items of item_size bytes
+                static size_t default_items_per_page(size_t item_size)
+                {
+                    return item_size <=   8 ? 32 :
+                           item_size <=  16 ? 16 :
+                           item_size <=  32 ?  8 :
+                           item_size <=  64 ?  4 :
+                           item_size <= 128 ?  2 :
+                           1;
+                }
+
+                // Smallest power of two not below n, at least lowest and at most limit
+                static size_t round_to_power_of_two(size_t n, size_t lowest, size_t limit)
+                {
+                    size_t result = lowest;
+                    while (result < n && result < limit) result <<= 1;
+                    return result;
+                }
             };
 
             inline bool is_valid_page(const concurrent_queue_rep_base::page* p)
@@ -77,6 +179,118 @@ namespace tbb
                 return uintptr_t(p)>1;
             }
 
+            /*
+             * Bounded lock-free pool of free pages
+             *
+             * Queues free one page for every page they allocate once a stream is running, so
+             * keeping a few drained pages back removes the allocator from the steady state.
+             * Slots are only exchanged with NULL, which avoids the ABA problem of a linked
+             * free list when several threads take pages. Zeroed memory is an empty pool.
+             */
+            template <typename Page, size_t N = 2>
+            class page_pool
+            {
+                atomic<Page*> my_slots[N];
+
+                public:
+                    void init()
+                    {
+                        for (size_t i = 0; i < N; ++i) my_slots[i] = NULL;
+                    }
+
+                    // A free page, or NULL if the pool is empty
+                    Page* take()
+                    {
+                        for (size_t i = 0; i < N; ++i)
+                        {
+                            if (my_slots[i] != NULL)
+                            {
+                                if (Page* p = my_slots[i].fetch_and_store(NULL)) return p;
+                            }
+                        }
+                        return NULL;
+                    }
+
+                    // Keep p, false if the pool is full
+                    bool put(Page* p)
+                    {
+                        for (size_t i = 0; i < N; ++i)
+                        {
+                            if (my_slots[i] == NULL && my_slots[i].compare_and_swap(p, NULL) == NULL) return true;
+                        }
+                        return false;
+                    }
+            };
+
+            /*
+             * Hand the popped item src over to dst with move_item and destroy it
+             *
+             * dst is whatever move_item expects: a T to assign to, raw storage, an optional.
+             * A NULL dst only destroys the item.
+             */
+            template <typename T>
+            void move_and_destroy_item(void* dst, T& src, void (*move_item)(void* dst, T& src))
+            {
+                __TBB_TRY {
+                    if (dst) move_item(dst, src);
+                } __TBB_CATCH(...) {
+                    src.~T();
+                    __TBB_RETHROW();
+                }
+                src.~T();
+            }
+
+            // Mover for popping into a constructed T at dst
+            template <typename T>
+            void move_assign_popped_item(void* dst, T& src)
+            {
+                *static_cast<T*>(dst) = tbb::internal::move(src);
+            }
+
+            // Mover for popping into raw storage: the item is move constructed at dst
+            template <typename T>
+            void move_construct_popped_item(void* dst, T& src)
+            {
+                new(dst) T(tbb::internal::move(src));
+            }
+
+#if __TBB_CPP17_OPTIONAL_PRESENT
+            // Mover for popping into an empty std::optional<T> at dst
+            template <typename T>
+            void emplace_popped_item(void* dst, T& src)
+            {
+                static_cast<std::optional<T>*>(dst)->emplace(std::move(src));
+            }
+#endif
+
+#if __TBB_CPP11_VARIADIC_TEMPLATES_PRESENT && __TBB_CPP11_RVALUE_REF_PRESENT
+            /*
+             * Constructor arguments of an emplace
+             *
+             * The queues take it as the source of construct_item, which builds the item
+             * right in its page slot from the forwarded arguments.
+             */
+            template <typename T, typename... Args>
+            class item_emplacer : no_copy
+            {
+                std::tuple<Args&&...> my_args;
+
+                template <std::size_t... I>
+                void construct(T* location, tbb::internal::index_sequence<I...>) const
+                {
+                    new(location) T(std::forward<Args>(std::get<I>(my_args))...);
+                }
+
+                public:
+                    item_emplacer(Args&&... args) : my_args(std::forward<Args>(args)...) {}
+
+                    static void construct_item(T* location, const void* src)
+                    {
+                        static_cast<const item_emplacer*>(src)->construct(location, tbb::internal::make_index_sequence<sizeof...(Args)>());
+                    }
+            };
+#endif
+
             class concurrent_queue_page_allocator
             {
                 template <typename T> friend class micro_queue;
@@ -96,16 +310,11 @@ namespace tbb
             {
                 public: 
                     typedef void (*item_constructor_t)(T* location, const void* src);
+                    // Moves a popped item to dst, see move_and_destroy_item
+                    typedef void (*item_mover_t)(void* dst, T& src);
 
                 private:
                     typedef concurrent_queue_rep_base::page page;
-                    class destroyer : no_copy
-                    {
-                        T& my_value;
-                        public: 
-                            destroyer(T& value) : my_value(value) {}
-                            ~destroyer() {my_value.~T();}
-                    };
 
                     void copy_item(page& dst, size_t dindex, const void* src, item_constructor_t construct_item)
                     {
@@ -118,13 +327,6 @@ namespace tbb
                         construct_item(&get_ref(dst, dindex), static_cast<const void*>(&src_item));
                     }
 
-                    void assign_and_destroy_item(void* dst, page& src, size_t index)
-                    {
-                        T& from = get_ref(src, index);
-                        destroyer d(from);
-                        *static_cast<T*>(dst) = tbb::internal::move(from);
-                    }
-
                     void spin_wait_until_my_turn(atomic<ticket>& counter, ticket k, concurrent_queue_rep_base& rb) const;
                 
                 public: 
@@ -142,20 +344,55 @@ namespace tbb
                         return (&static_cast<padded_page*>(static_cast<void*>(&p))->last)[index];
                     }
 
+                    // Bytes of a page, with the enqueue stamps of an instrumented queue
+                    static size_t page_size(size_t items_per_page, bool instrumented)
+                    {
+                        size_t n = sizeof(padded_page) + (items_per_page-1)*sizeof(T);
+                        return instrumented ? n + sizeof(tick_count)-1 + items_per_page*sizeof(tick_count) : n;
+                    }
+
+                    // Enqueue stamp of item index in an instrumented queue, aligned behind the items
+                    static tick_count& get_stamp(page& p, size_t index, size_t items_per_page)
+                    {
+                        uintptr_t end = reinterpret_cast<uintptr_t>(&get_ref(p, 0) + items_per_page);
+                        end = (end + sizeof(tick_count)-1) & ~uintptr_t(sizeof(tick_count)-1);
+                        return reinterpret_cast<tick_count*>(end)[index];
+                    }
+
                     atomic<page*> head_page;
                     atomic<ticket> head_counter;
                     atomic<page*> tail_page;
                     atomic<ticket> tail_counter;
                     spin_mutex page_mutex;
+                    // Drained pages kept for the next pushes; two pages cover a queue that empties at a page boundary
+                    page_pool<page> free_pages;
+
+                    page* acquire_page(concurrent_queue_page_allocator& pa)
+                    {
+                        page* p = free_pages.take();
+                        return p ? p : pa.allocate_page();
+                    }
+
+                    void release_page(page* p, concurrent_queue_page_allocator& pa)
+                    {
+                        if (!free_pages.put(p))
+                        {
+                            pa.deallocate_page(p);
+                        }
+                    }
 
                     void push(const void* item, ticket k, concurrent_queue_base_v3<T>& base, 
                                 item_constructor_t construct_item);
-                    bool pop(void* dst, ticket k, concurrent_queue_base_v3<T>& base);
+                    bool pop(void* dst, ticket k, concurrent_queue_base_v3<T>& base, item_mover_t move_item = move_assign_popped_item<T>);
+                    void push_n(const T* items, size_t count, ticket k, concurrent_queue_base_v3<T>& base,
+                                item_constructor_t construct_item);
+                    void wait_for_range(ticket k, ticket last, size_t n_queue);
+                    bool pop_item(void* dst, ticket k, concurrent_queue_base_v3<T>& base, item_mover_t move_item = move_assign_popped_item<T>);
                     micro_queue& assign(const micro_queue& src, concurrent_queue_base_v3<T>& base, 
                                             item_constructor_t construct_item);
                     page* make_copy(concurrent_queue_base_v3<T>& base, const page* src_page, size_t begin_in_page,
                         size_t end_in_page, ticket& g_index, item_constructor_t construct_item);
-                    void invalidate_page_and_rethrow(ticket k);
+                    void invalidate_page_and_rethrow(ticket k, size_t n_queue);
             };
 
             template <typename T>
@@ -177,18 +414,18 @@ namespace tbb
             void micro_queue<T>::push(const void* item, ticket k, concurrent_queue_base_v3<T>& base, 
                                         item_constructor_t construct_item)
             {
-                k &= -concurrent_queue_rep_base::n_queue;
+                const size_t n_queue = base.my_rep->n_queue;
+                k &= -n_queue;
                 page* p = NULL;
-                size_t index = modulo_power_of_two(k/concurrent_queue_rep_base::n_queue, 
+                size_t index = modulo_power_of_two(k/n_queue, 
                                                     base.my_rep->items_per_page);
                 if (!index)
                 {
                     __TBB_TRY {
-                        concurrent_queue_page_allocator& pa = base;
-                        p = pa.allocate_page();
+                        p = acquire_page(base);
                     } __TBB_CATCH(...) {
                         ++base.my_rep->n_invalid_entries;
-                        invalidate_page_and_rethrow(k);
+                        invalidate_page_and_rethrow(k, n_queue);
                     }
                     p->mask = 0;
                     p->next = NULL;
@@ -218,36 +455,154 @@ namespace tbb
 
                 __TBB_TRY {
                     copy_item(*p, index, item, construct_item);
+                    if (base.my_rep->instrumentation)
+                    {
+                        get_stamp(*p, index, base.my_rep->items_per_page) = tick_count::now();
+                    }
                     itt_hide_store_word(p->mask, p->mask | uintptr_t(1)<<index);
                     call_itt_notify(releasing, &tail_counter);
-                    tail_counter += concurrent_queue_rep_base::n_queue;
+                    tail_counter += n_queue;
                 } __TBB_CATCH(...) {
                     ++base.my_rep->n_invalid_entries;
                     call_itt_notify(releasing, &tail_counter);
-                    tail_counter += concurrent_queue_rep_base::n_queue;
+                    tail_counter += n_queue;
                     __TBB_RETHROW();
                 }
             }
 
             template <typename T>
-            bool micro_queue<T>::pop(void* dst, ticket k, concurrent_queue_base_v3<T>& base)
+            bool micro_queue<T>::pop(void* dst, ticket k, concurrent_queue_base_v3<T>& base, item_mover_t move_item)
             {
-                k &= -concurrent_queue_rep_base::n_queue;
+                const size_t n_queue = base.my_rep->n_queue;
+                k &= -n_queue;
                 if (head_counter != k) spin_wait_until_eq(head_counter, k);
                 call_itt_notify(acquired, &head_counter);
                 if (tail_counter == k) spin_wait_while_eq(tail_counter, k);
                 call_itt_notify(acquired, &tail_counter);
+                return pop_item(dst, k, base, move_item);
+            }
+
+            /*
+             * Push items[0], items[n_queue], ... items[(count-1)*n_queue] at the tickets k, k+n_queue, ...
+             *
+             * The pages that start inside the batch are allocated before the turn is taken and
+             * linked under one lock, and tail_counter is bumped once for the whole batch.
+             * A null construct_item fills the tickets with invalid entries.
+             */
+            template <typename T>
+            void micro_queue<T>::push_n(const T* items, size_t count, ticket k, concurrent_queue_base_v3<T>& base,
+                                        item_constructor_t construct_item)
+            {
+                const size_t n_queue = base.my_rep->n_queue;
+                k &= -n_queue;
+                const size_t items_per_page = base.my_rep->items_per_page;
+                size_t first = modulo_power_of_two(k/n_queue, items_per_page);
+                size_t n_pages = (first+count-1)/items_per_page + (first ? 0 : 1);
+                page* pages = NULL;
+                page* last_page = NULL;
+                concurrent_queue_page_allocator& pa = base;
+                __TBB_TRY {
+                    for (; n_pages; --n_pages)
+                    {
+                        page* p = acquire_page(pa);
+                        p->mask = 0;
+                        p->next = NULL;
+                        if (last_page) last_page->next = p; else pages = p;
+                        last_page = p;
+                    }
+                } __TBB_CATCH(...) {
+                    while (pages)
+                    {
+                        page* next = pages->next;
+                        release_page(pages, pa);
+                        pages = next;
+                    }
+                    base.my_rep->n_invalid_entries += count;
+                    invalidate_page_and_rethrow(k + (count-1)*n_queue, n_queue);
+                }
+
+                if (tail_counter != k) spin_wait_until_my_turn(tail_counter, k, *base.my_rep);
+                call_itt_notify(acquired, &tail_counter);
+
+                page* p = first ? tail_page : pages;
+                if (pages)
+                {
+                    spin_mutex::scoped_lock lock(page_mutex);
+                    page* q = tail_page;
+                    if (is_valid_page(q))
+                    {
+                        q->next = pages;
+                    }
+                    else
+                    {
+                        head_page = pages;
+                    }
+                    tail_page = last_page;
+                }
+
+                size_t j = 0;
+                __TBB_TRY {
+                    if (construct_item)
+                    {
+                        // One stamp for the batch
+                        tick_count now;
+                        if (base.my_rep->instrumentation) now = tick_count::now();
+                        for (size_t index = first; j < count; ++j, ++index)
+                        {
+                            if (index == items_per_page)
+                            {
+                                p = p->next;
+                                index = 0;
+                            }
+                            copy_item(*p, index, items + j*n_queue, construct_item);
+                            if (base.my_rep->instrumentation) get_stamp(*p, index, items_per_page) = now;
+                            itt_hide_store_word(p->mask, p->mask | uintptr_t(1)<<index);
+                        }
+                    }
+                } __TBB_CATCH(...) {
+                    base.my_rep->n_invalid_entries += count-j;
+                    call_itt_notify(releasing, &tail_counter);
+                    tail_counter += count*n_queue;
+                    __TBB_RETHROW();
+                }
+                if (j < count) base.my_rep->n_invalid_entries += count-j;
+                call_itt_notify(releasing, &tail_counter);
+                tail_counter += count*n_queue;
+            }
+
+            // Wait until the items of this queue with tickets k..last are pushed and all before k are popped
+            template <typename T>
+            void micro_queue<T>::wait_for_range(ticket k, ticket last, size_t n_queue)
+            {
+                k &= -n_queue;
+                last &= -n_queue;
+                if (head_counter != k) spin_wait_until_eq(head_counter, k);
+                call_itt_notify(acquired, &head_counter);
+                for (atomic_backoff b; (ptrdiff_t)(tail_counter-last) <= 0; b.pause()) {}
+                call_itt_notify(acquired, &tail_counter);
+            }
+
+            // Pop the item with ticket k once it is at the head; a null dst destroys the item
+            template <typename T>
+            bool micro_queue<T>::pop_item(void* dst, ticket k, concurrent_queue_base_v3<T>& base, item_mover_t move_item)
+            {
+                const size_t n_queue = base.my_rep->n_queue;
+                k &= -n_queue;
                 page *p = head_page;
                 __TBB_ASSERT(p, NULL);
-                size_t index = modulo_power_of_two(k/concurrent_queue_rep_base::n_queue, base.my_rep->items_per_page);
+                size_t index = modulo_power_of_two(k/n_queue, base.my_rep->items_per_page);
                 bool success = false;
                 {
-                    micro_queue_pop_finalizer<T> finalizer(*this, base, k+concurrent_queue_rep_base::n_queue, 
+                    micro_queue_pop_finalizer<T> finalizer(*this, base, k+n_queue, 
                                                     index==base.my_rep->items_per_page-1 ? p : NULL);
                     if (p->mask & uintptr_t(1)<<index)
                     {
                         success = true;
-                        assign_and_destroy_item(dst, *p, index);
+                        if (queue_instrumentation* qi = base.my_rep->instrumentation)
+                        {
+                            qi->record_latency(get_stamp(*p, index, base.my_rep->items_per_page));
+                        }
+                        move_and_destroy_item(dst, get_ref(*p, index), move_item);
                     }
                     else 
                     {
@@ -261,6 +616,7 @@ namespace tbb
             micro_queue<T>& micro_queue<T>::assign(const micro_queue<T>& src, concurrent_queue_base_v3<T>& base, 
                 item_constructor_t construct_item)
             {
+                const size_t n_queue = base.my_rep->n_queue;
                 head_counter = src.head_counter;
                 tail_counter = src.tail_counter;
 
@@ -269,8 +625,8 @@ namespace tbb
                 {
                     ticket g_index = head_counter;
                     __TBB_TRY {
-                        size_t n_items = (tail_counter - head_counter)/concurrent_queue_rep_base::n_queue;
-                        size_t index = modulo_power_of_two(head_counter/concurrent_queue_rep_base::n_queue, 
+                        size_t n_items = (tail_counter - head_counter)/n_queue;
+                        size_t index = modulo_power_of_two(head_counter/n_queue, 
                                         base.my_rep->items_per_page);
                         size_t end_in_first_page = (index + n_items < base.my_rep->items_per_page) 
                                 ? (index + n_items):base.my_rep->items_per_page;
@@ -288,7 +644,7 @@ namespace tbb
                             }
 
                             __TBB_ASSERT(srcp == src.tail_page, NULL);
-                            size_t last_index = modulo_power_of_two(tail_counter/concurrent_queue_rep_base::n_queue,
+                            size_t last_index = modulo_power_of_two(tail_counter/n_queue,
                                                                     base.my_rep->items_per_page);
                             if (last_index == 0) last_index = base.my_rep->items_per_page;
                             cur_page->next = make_copy(base, srcp, 0, last_index, g_index, construct_item);
@@ -296,7 +652,7 @@ namespace tbb
                         }
                         tail_page = cur_page;
                     } __TBB_CATCH(...) {
-                        invalidate_page_and_rethrow(g_index);
+                        invalidate_page_and_rethrow(g_index, n_queue);
                     }
                 } else {
                     head_page = tail_page = NULL;
@@ -305,13 +661,13 @@ namespace tbb
             }
 
             template <typename T>
-            void micro_queue<T>::invalidate_page_and_rethrow(ticket k)
+            void micro_queue<T>::invalidate_page_and_rethrow(ticket k, size_t n_queue)
             {
                 /* Append an invalid page at address i so that no more pushes are allowed */
                 page* invalid_page = (page*)uintptr_t(1);
                 {
                     spin_mutex::scoped_lock lock(page_mutex);
-                    itt_store_word_with_release(tail_counter, k + concurrent_queue_rep_base::n_queue+1);
+                    itt_store_word_with_release(tail_counter, k + n_queue+1);
                     page* q = tail_page;
                     if (is_valid_page(q))
                     {
@@ -331,8 +687,7 @@ namespace tbb
                 const concurrent_queue_rep_base::page* src_page, size_t begin_in_page, size_t end_in_page,
                 ticket& g_index, item_constructor_t construct_item)
             {
-                concurrent_queue_page_allocator& pa = base;
-                page* new_page = pa.allocate_page();
+                page* new_page = acquire_page(base);
                 new_page->next = NULL;
                 new_page->mask = src_page->mask;
                 for (; begin_in_page != end_in_page; ++begin_in_page, ++g_index)
@@ -378,9 +733,1115 @@ namespace tbb
                 itt_store_word_with_release(my_queue.head_counter, my_ticket);
                 if (is_valid_page(p))
                 {
-                    allocator.deallocate_page(p);
+                    my_queue.release_page(p, allocator);
+                }
+            }
+
+            // Representation of concurrent_queue_base_v3, allocated with room for n_queue micro_queues
+            template <typename T>
+            struct concurrent_queue_rep : public concurrent_queue_rep_base
+            {
+                micro_queue<T> array[1];
+
+                static size_t allocation_size(size_t n_queue)
+                {
+                    return sizeof(concurrent_queue_rep) + (n_queue-1)*sizeof(micro_queue<T>);
+                }
+
+                // Map ticket to an array index
+                size_t index(ticket k) const
+                {
+                    return modulo_power_of_two(k*phi, n_queue);
+                }
+
+                micro_queue<T>& choose(ticket k)
+                {
+                    // The formula here approximates LRU in a cache-oblivious way
+                    return array[index(k)];
+                }
+            };
+
+            template <typename T>
+            class concurrent_queue_base_v3 : public concurrent_queue_page_allocator
+            {
+                private:
+                    concurrent_queue_rep<T>* my_rep;
+
+                    friend struct concurrent_queue_rep<T>;
+                    friend class micro_queue<T>;
+                    friend class concurrent_bounded_queue_base<T>;
+
+                protected:
+                    typedef typename concurrent_queue_rep<T>::page page;
+
+                private:
+                    typedef typename micro_queue<T>::padded_page padded_page;
+                    typedef typename micro_queue<T>::item_constructor_t item_constructor_t;
+                    typedef typename micro_queue<T>::item_mover_t item_mover_t;
+
+                    page* allocate_page() __TBB_override
+                    {
+                        concurrent_queue_rep<T>& r = *my_rep;
+                        size_t n = micro_queue<T>::page_size(r.items_per_page, r.instrumentation != NULL);
+                        return reinterpret_cast<page*>(allocate_block(n));
+                    }
+
+                    void deallocate_page(concurrent_queue_rep_base::page* p) __TBB_override
+                    {
+                        concurrent_queue_rep<T>& r = *my_rep;
+                        size_t n = micro_queue<T>::page_size(r.items_per_page, r.instrumentation != NULL);
+                        deallocate_block(reinterpret_cast<void*>(p), n);
+                    }
+
+                    // Custom allocator
+                    virtual void* allocate_block(size_t n) = 0;
+
+                    // Custom de-allocator
+                    virtual void deallocate_block(void* p, size_t n) = 0;
+
+                protected:
+                    /*
+                     * n_queue micro_queues with pages of items_per_page items; both are rounded up to
+                     * powers of two, n_queue to at least 2, items_per_page is capped at the bits of
+                     * a page mask, and zero picks the defaults. An instrumented queue keeps a
+                     * queue_instrumentation and stamps its items.
+                     */
+                    concurrent_queue_base_v3(size_t n_queue = 0, size_t items_per_page = 0, bool instrumented = false);
+
+                    virtual ~concurrent_queue_base_v3()
+                    {
+#if TBB_USE_ASSERT
+                        for (size_t i = 0; i < my_rep->n_queue; ++i)
+                        {
+                            __TBB_ASSERT(my_rep->array[i].tail_page == NULL, "pages were not freed properly");
+                        }
+#endif
+                        if (my_rep->instrumentation)
+                        {
+                            cache_aligned_allocator<queue_instrumentation>().deallocate(my_rep->instrumentation, 1);
+                        }
+                        cache_aligned_allocator<char>().deallocate(reinterpret_cast<char*>(my_rep),
+                            concurrent_queue_rep<T>::allocation_size(my_rep->n_queue));
+                    }
+
+                    // Raise the high-water mark of an instrumented queue to the size once ticket k is pushed
+                    void record_push(ticket k)
+                    {
+                        concurrent_queue_rep<T>& r = *my_rep;
+                        if (r.instrumentation) r.instrumentation->record_size((ptrdiff_t)(k+1-r.head_counter));
+                    }
+
+                    // Enqueue item at tail of queue
+                    void internal_push(const void* src, item_constructor_t construct_item)
+                    {
+                        concurrent_queue_rep<T>& r = *my_rep;
+                        ticket k = r.tail_counter++;
+                        record_push(k);
+                        r.choose(k).push(src, k, *this, construct_item);
+                    }
+
+                    // Enqueue src[0..n) at consecutive tickets
+                    void internal_push_n(const T* src, size_t n, item_constructor_t construct_item)
+                    {
+                        if (!n) return;
+                        ticket k = my_rep->tail_counter.fetch_and_add(n);
+                        internal_push_range(src, n, k, construct_item);
+                    }
+
+                    void internal_push_range(const T* src, size_t n, ticket k, item_constructor_t construct_item);
+
+                    // Attempt to dequeue item from queue, false if there was no item to dequeue
+                    bool internal_try_pop(void* dst, item_mover_t move_item = move_assign_popped_item<T>);
+
+                    // Dequeue up to n items into dst, returns the number of items dequeued
+                    size_t internal_try_pop_n(T* dst, size_t n)
+                    {
+                        ticket k;
+                        size_t m = internal_reserve_pop_range(n, k);
+                        return m ? internal_pop_range(dst, k, m) : 0;
+                    }
+
+                    // Take up to n head tickets of pushed items at once, returns how many were taken from k on
+                    size_t internal_reserve_pop_range(size_t n, ticket& k);
+
+                    size_t internal_pop_range(T* dst, ticket k, size_t m);
+
+                    // Get size of queue; result may be invalid if queue is modified concurrently
+                    size_t internal_size() const;
+
+                    // Check if the queue is empty; thread safe
+                    bool internal_empty() const;
+
+                    // Snapshot of the counters; the fields are read one by one while the queue may change
+                    void internal_statistics(queue_statistics& s) const;
+
+                    // Free any remaining pages
+                    void internal_finish_clear();
+            };
+
+            template <typename T>
+            concurrent_queue_base_v3<T>::concurrent_queue_base_v3(size_t n_queue, size_t items_per_page, bool instrumented)
+            {
+                const size_t item_size = sizeof(T);
+                // Micro_queue counters step by n_queue and use bit 0 to flag a failed push, so n_queue >= 2
+                n_queue = n_queue ? concurrent_queue_rep_base::round_to_power_of_two(n_queue, 2, ~size_t(0)/2+1)
+                                  : concurrent_queue_rep_base::default_n_queue;
+                items_per_page = items_per_page ? concurrent_queue_rep_base::round_to_power_of_two(items_per_page, 1, 8*sizeof(uintptr_t))
+                                                : concurrent_queue_rep_base::default_items_per_page(item_size);
+                const size_t n = concurrent_queue_rep<T>::allocation_size(n_queue);
+                my_rep = reinterpret_cast<concurrent_queue_rep<T>*>(cache_aligned_allocator<char>().allocate(n));
+                __TBB_ASSERT((size_t)my_rep % NFS_GetLineSize() == 0, "alignment error");
+                __TBB_ASSERT((size_t)&my_rep->head_counter % NFS_GetLineSize() == 0, "alignment error");
+                __TBB_ASSERT((size_t)&my_rep->tail_counter % NFS_GetLineSize() == 0, "alignment error");
+                __TBB_ASSERT((size_t)&my_rep->array % NFS_GetLineSize() == 0, "alignment error");
+                memset(static_cast<void*>(my_rep), 0, n);
+                my_rep->n_queue = n_queue;
+                my_rep->phi = n_queue*382/1000 | 1;
+                my_rep->item_size = item_size;
+                my_rep->items_per_page = items_per_page;
+                if (instrumented)
+                {
+                    __TBB_TRY {
+                        my_rep->instrumentation = cache_aligned_allocator<queue_instrumentation>().allocate(1);
+                    } __TBB_CATCH(...) {
+                        cache_aligned_allocator<char>().deallocate(reinterpret_cast<char*>(my_rep), n);
+                        __TBB_RETHROW();
+                    }
+                    my_rep->instrumentation->init();
+                }
+            }
+
+            template <typename T>
+            bool concurrent_queue_base_v3<T>::internal_try_pop(void* dst, item_mover_t move_item)
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                ticket k;
+                do {
+                    k = r.head_counter;
+                    for (;;)
+                    {
+                        if ((ptrdiff_t)(r.tail_counter-k) <= 0)
+                        {
+                            // Queue is empty
+                            return false;
+                        }
+                        // Queue had item with ticket k when we looked, attempt to get that item
+                        ticket tk = k;
+                        k = r.head_counter.compare_and_swap(tk+1, tk);
+                        if (k == tk) break;
+                        // Another thread snatched the item, retry
+                    }
+                } while (!r.choose(k).pop(dst, k, *this, move_item));
+                return true;
+            }
+
+            /*
+             * Enqueue src[i] at ticket k+i for i in [0,n)
+             *
+             * Every micro_queue gets its share of the range in one push_n, which waits for its
+             * turn and bumps its tail_counter once. If constructing an item throws, the rest
+             * of the range is filled with invalid entries, so pops skip it, and the exception
+             * is rethrown; items already pushed stay in the queue.
+             */
+            template <typename T>
+            void concurrent_queue_base_v3<T>::internal_push_range(const T* src, size_t n, ticket k,
+                                                                  item_constructor_t construct_item)
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                record_push(k+n-1);
+                const size_t n_queue = r.n_queue;
+                size_t shares = n < n_queue ? n : n_queue;
+                size_t q = 0;
+                __TBB_TRY {
+                    for (; q < shares; ++q)
+                    {
+                        r.choose(k+q).push_n(src+q, (n-q+n_queue-1)/n_queue, k+q, *this, construct_item);
+                    }
+                } __TBB_CATCH(...) {
+                    // The tickets are taken, the other micro_queues must still move past them
+                    for (++q; q < shares; ++q)
+                    {
+                        __TBB_TRY {
+                            r.choose(k+q).push_n(src+q, (n-q+n_queue-1)/n_queue, k+q, *this, NULL);
+                        } __TBB_CATCH(...) {}
+                    }
+                    __TBB_RETHROW();
+                }
+            }
+
+            template <typename T>
+            size_t concurrent_queue_base_v3<T>::internal_reserve_pop_range(size_t n, ticket& k)
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                k = r.head_counter;
+                for (;;)
+                {
+                    ptrdiff_t available = (ptrdiff_t)(r.tail_counter-k);
+                    if (available <= 0 || !n)
+                    {
+                        // Queue is empty
+                        return 0;
+                    }
+                    size_t m = size_t(available) < n ? size_t(available) : n;
+                    ticket tk = k;
+                    k = r.head_counter.compare_and_swap(tk+m, tk);
+                    if (k == tk) return m;
+                    // Other threads took some of the items, retry
                 }
             }
+
+            /*
+             * Dequeue the items with tickets [k,k+m) into dst, in ticket order
+             *
+             * Each micro_queue waits once until its share of the range has been pushed and
+             * its earlier items popped; after that the items are moved out with plain stores
+             * to the head counters. Invalid entries are skipped, so fewer than m items may be
+             * returned. If moving an item throws, it and the rest of the range are destroyed.
+             */
+            template <typename T>
+            size_t concurrent_queue_base_v3<T>::internal_pop_range(T* dst, ticket k, size_t m)
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                const size_t n_queue = r.n_queue;
+                size_t shares = m < n_queue ? m : n_queue;
+                for (size_t q = 0; q < shares; ++q)
+                {
+                    r.choose(k+q).wait_for_range(k+q, k+q+(m-1-q)/n_queue*n_queue, n_queue);
+                }
+                size_t popped = 0;
+                size_t i = 0;
+                __TBB_TRY {
+                    for (; i < m; ++i)
+                    {
+                        if (r.choose(k+i).pop_item(dst+popped, k+i, *this)) ++popped;
+                    }
+                } __TBB_CATCH(...) {
+                    for (++i; i < m; ++i)
+                    {
+                        r.choose(k+i).pop_item(NULL, k+i, *this);
+                    }
+                    __TBB_RETHROW();
+                }
+                return popped;
+            }
+
+            template <typename T>
+            size_t concurrent_queue_base_v3<T>::internal_size() const
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                ticket hc = r.head_counter;
+                size_t nie = r.n_invalid_entries;
+                ticket tc = r.tail_counter;
+                __TBB_ASSERT(hc != tc || !nie, NULL);
+                ptrdiff_t sz = tc-hc-nie;
+                return sz < 0 ? 0 : size_t(sz);
+            }
+
+            template <typename T>
+            bool concurrent_queue_base_v3<T>::internal_empty() const
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                ticket tc = r.tail_counter;
+                ticket hc = r.head_counter;
+                // If tc != r.tail_counter, the queue was not empty at some point between the two reads
+                return tc == r.tail_counter && tc == hc+r.n_invalid_entries;
+            }
+
+            template <typename T>
+            void concurrent_queue_base_v3<T>::internal_statistics(queue_statistics& s) const
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                s = queue_statistics();
+                ticket hc = r.head_counter;
+                ticket tc = r.tail_counter;
+                s.size = (ptrdiff_t)(tc-hc) > 0 ? size_t(tc-hc) : 0;
+                s.invalid_entries = r.n_invalid_entries;
+                if (r.instrumentation) r.instrumentation->fill(s);
+            }
+
+            template <typename T>
+            void concurrent_queue_base_v3<T>::internal_finish_clear()
+            {
+                concurrent_queue_rep<T>& r = *my_rep;
+                for (size_t i = 0; i < r.n_queue; ++i)
+                {
+                    page* tp = r.array[i].tail_page;
+                    if (is_valid_page(tp))
+                    {
+                        __TBB_ASSERT(r.array[i].head_page == tp, "at most one page should remain");
+                        deallocate_page(tp);
+                        r.array[i].tail_page = NULL;
+                    }
+                    else
+                    {
+                        __TBB_ASSERT(!is_valid_page(r.array[i].head_page), "head page pointer corrupt?");
+                    }
+                    while (page* fp = r.array[i].free_pages.take())
+                    {
+                        deallocate_page(fp);
+                    }
+                }
+            }
+
+            /*
+             * Blocking operations of concurrent_bounded_queue
+             *
+             * Tickets are handed out as in concurrent_queue_base_v3, but a push waits until
+             * its ticket is less than capacity ahead of head_counter, and a pop may take a
+             * ticket whose item has not been pushed yet and wait for it. Both long waits park
+             * the thread in the bucket of its ticket: the push of ticket k wakes bucket k of
+             * my_items_avail, and the pop of ticket k, which lets ticket k+capacity in, wakes
+             * that bucket of my_slots_avail. Only the waiters of one bucket are woken, not
+             * every parked thread. A timed pop waits for any item on my_not_empty instead.
+             * A thread only enters micro_queue::push or pop once the wait is over, so the
+             * spins in there are left for neighbours in the same micro_queue that are
+             * mid-operation.
+             */
+            template <typename T>
+            class concurrent_bounded_queue_base : public concurrent_queue_base_v3<T>
+            {
+                typedef typename micro_queue<T>::item_constructor_t item_constructor_t;
+                typedef typename micro_queue<T>::item_mover_t item_mover_t;
+
+                protected:
+                    static const size_t n_wait_buckets = 32;
+
+                    ptrdiff_t my_capacity;
+                    futex_event_buckets<n_wait_buckets> my_items_avail;
+                    futex_event_buckets<n_wait_buckets> my_slots_avail;
+                    futex_event my_not_empty;
+
+                    concurrent_bounded_queue_base(size_t n_queue = 0, size_t items_per_page = 0, bool instrumented = false) :
+                        concurrent_queue_base_v3<T>(n_queue, items_per_page, instrumented)
+                    {
+                        my_capacity = ptrdiff_t(size_t(-1)/(sizeof(T) > 1 ? sizeof(T) : 2)/2);
+                    }
+
+                    // Enqueue item at tail of queue, waiting while the queue is full
+                    void internal_push(const void* src, item_constructor_t construct_item)
+                    {
+                        ticket k = this->my_rep->tail_counter++;
+                        wait_for_slot(k);
+                        push_ticket(src, k, construct_item);
+                    }
+
+                    // Enqueue item at tail of queue unless the queue is full
+                    bool internal_push_if_not_full(const void* src, item_constructor_t construct_item)
+                    {
+                        concurrent_queue_rep<T>& r = *this->my_rep;
+                        ticket k = r.tail_counter;
+                        for (;;)
+                        {
+                            if ((ptrdiff_t)(k-r.head_counter) >= my_capacity)
+                            {
+                                // Queue is full
+                                return false;
+                            }
+                            ticket tk = k;
+                            k = r.tail_counter.compare_and_swap(tk+1, tk);
+                            if (k == tk) break;
+                        }
+                        push_ticket(src, k, construct_item);
+                        return true;
+                    }
+
+                    // Enqueue src[0..n) at consecutive tickets, in batches of at most capacity items
+                    void internal_push_n(const T* src, size_t n, item_constructor_t construct_item)
+                    {
+                        while (n)
+                        {
+                            ptrdiff_t capacity = __TBB_load_with_acquire(my_capacity);
+                            size_t m = capacity < 1 ? 1 : size_t(capacity) < n ? size_t(capacity) : n;
+                            ticket k = this->my_rep->tail_counter.fetch_and_add(m);
+                            wait_for_slot(k+m-1);
+                            __TBB_TRY {
+                                this->internal_push_range(src, m, k, construct_item);
+                            } __TBB_CATCH(...) {
+                                notify_items(k, m);
+                                __TBB_RETHROW();
+                            }
+                            notify_items(k, m);
+                            src += m;
+                            n -= m;
+                        }
+                    }
+
+                    // Dequeue up to n items into dst, returns the number of items dequeued
+                    size_t internal_pop_n_if_present(T* dst, size_t n)
+                    {
+                        ticket k;
+                        size_t m = this->internal_reserve_pop_range(n, k);
+                        if (!m) return 0;
+                        notify_slots(k, m);
+                        // The last ticket of every micro_queue share comes last in that micro_queue
+                        const size_t n_queue = this->my_rep->n_queue;
+                        for (size_t i = m > n_queue ? m-n_queue : 0; i < m; ++i)
+                        {
+                            wait_for_item(k+i);
+                        }
+                        return this->internal_pop_range(dst, k, m);
+                    }
+
+                    // Dequeue item from head of queue, waiting while the queue is empty
+                    void internal_pop(void* dst, item_mover_t move_item = move_assign_popped_item<T>)
+                    {
+                        ticket k;
+                        do {
+                            k = this->my_rep->head_counter++;
+                        } while (!pop_ticket(dst, k, move_item));
+                    }
+
+                    // Attempt to dequeue item from queue, false if there was no item to dequeue
+                    bool internal_pop_if_present(void* dst, item_mover_t move_item = move_assign_popped_item<T>)
+                    {
+                        concurrent_queue_rep<T>& r = *this->my_rep;
+                        ticket k;
+                        do {
+                            k = r.head_counter;
+                            for (;;)
+                            {
+                                if ((ptrdiff_t)(r.tail_counter-k) <= 0)
+                                {
+                                    // Queue is empty
+                                    return false;
+                                }
+                                ticket tk = k;
+                                k = r.head_counter.compare_and_swap(tk+1, tk);
+                                if (k == tk) break;
+                            }
+                        } while (!pop_ticket(dst, k, move_item));
+                        return true;
+                    }
+
+                    /*
+                     * Dequeue item from head of queue, waiting at most timeout for one to arrive
+                     *
+                     * Unlike internal_pop(), no ticket is taken before an item is there, so a pop
+                     * that times out leaves nothing behind in the queue.
+                     */
+                    bool internal_pop_for(void* dst, const tick_count::interval_t& timeout, item_mover_t move_item = move_assign_popped_item<T>)
+                    {
+                        tick_count start = tick_count::now();
+                        for (;;)
+                        {
+                            if (internal_pop_if_present(dst, move_item)) return true;
+                            tick_count::interval_t left = timeout - (tick_count::now() - start);
+                            if (left.seconds() <= 0 || !my_not_empty.wait_for(not_empty_t(*this), left))
+                            {
+                                return internal_pop_if_present(dst, move_item);
+                            }
+                        }
+                    }
+
+                    // Number of items minus the number of pending pops; may be negative
+                    ptrdiff_t internal_size() const
+                    {
+                        concurrent_queue_rep<T>& r = *this->my_rep;
+                        ticket hc = r.head_counter;
+                        size_t nie = r.n_invalid_entries;
+                        ticket tc = r.tail_counter;
+                        return ptrdiff_t(tc-hc-nie);
+                    }
+
+                    void internal_set_capacity(ptrdiff_t capacity)
+                    {
+                        __TBB_ASSERT(capacity >= 0, "negative capacity");
+                        my_capacity = capacity;
+                        // Pushes blocked on the old capacity recheck their tickets
+                        __TBB_full_memory_fence();
+                        my_slots_avail.notify_all();
+                    }
+
+                private:
+                    // Wake the consumers of tickets [k,k+n), whose items were pushed or invalidated
+                    void notify_items(ticket k, size_t n)
+                    {
+                        my_items_avail.notify(k, n);
+                        my_not_empty.notify_all();
+                    }
+
+                    // Wake the producers that popping tickets [k,k+n) let in
+                    void notify_slots(ticket k, size_t n)
+                    {
+                        my_slots_avail.notify(k + ticket(__TBB_load_with_acquire(my_capacity)), n);
+                    }
+
+                    bool slot_available(ticket k) const
+                    {
+                        return (ptrdiff_t)(k-this->my_rep->head_counter) < __TBB_load_with_acquire(my_capacity);
+                    }
+
+                    // The micro_queue tail passed k once the item with ticket k has been pushed
+                    bool item_available(ticket k) const
+                    {
+                        micro_queue<T>& q = this->my_rep->choose(k);
+                        return (ptrdiff_t)(q.tail_counter-(k & -this->my_rep->n_queue)) > 0;
+                    }
+
+                    bool not_empty() const
+                    {
+                        concurrent_queue_rep<T>& r = *this->my_rep;
+                        return (ptrdiff_t)(r.tail_counter-r.head_counter) > 0;
+                    }
+
+                    // Predicates for futex_event::wait
+                    class slot_available_t : no_assign
+                    {
+                        const concurrent_bounded_queue_base& my_queue;
+                        const ticket my_ticket;
+                        public:
+                            slot_available_t(const concurrent_bounded_queue_base& q, ticket k) : my_queue(q), my_ticket(k) {}
+                            bool operator()() const {return my_queue.slot_available(my_ticket);}
+                    };
+
+                    class item_available_t : no_assign
+                    {
+                        const concurrent_bounded_queue_base& my_queue;
+                        const ticket my_ticket;
+                        public:
+                            item_available_t(const concurrent_bounded_queue_base& q, ticket k) : my_queue(q), my_ticket(k) {}
+                            bool operator()() const {return my_queue.item_available(my_ticket);}
+                    };
+
+                    class not_empty_t : no_assign
+                    {
+                        const concurrent_bounded_queue_base& my_queue;
+                        public:
+                            not_empty_t(const concurrent_bounded_queue_base& q) : my_queue(q) {}
+                            bool operator()() const {return my_queue.not_empty();}
+                    };
+
+                    void wait_for_slot(ticket k)
+                    {
+                        my_slots_avail[k].wait(slot_available_t(*this, k));
+                    }
+
+                    void wait_for_item(ticket k)
+                    {
+                        my_items_avail[k].wait(item_available_t(*this, k));
+                    }
+
+                    void push_ticket(const void* src, ticket k, item_constructor_t construct_item)
+                    {
+                        this->record_push(k);
+                        __TBB_TRY {
+                            this->my_rep->choose(k).push(src, k, *this, construct_item);
+                        } __TBB_CATCH(...) {
+                            // The ticket was invalidated, its consumer must not sleep on it
+                            notify_items(k, 1);
+                            __TBB_RETHROW();
+                        }
+                        notify_items(k, 1);
+                    }
+
+                    // Pop the item with ticket k after head_counter was moved past k
+                    bool pop_ticket(void* dst, ticket k, item_mover_t move_item)
+                    {
+                        notify_slots(k, 1);
+                        wait_for_item(k);
+                        return this->my_rep->choose(k).pop(dst, k, *this, move_item);
+                    }
+            };
+
+            /*
+             * Page plumbing of the single consumer queues
+             *
+             * Pages start with a concurrent_queue_rep_base::page header, extended by Page
+             * where a queue needs more per page state, followed by my_items_per_page items.
+             * They come from the allocate_block/deallocate_block pair the public queue
+             * implements with its allocator.
+             */
+            template <typename T, typename Page = concurrent_queue_rep_base::page>
+            class concurrent_queue_page_source : no_copy
+            {
+                protected:
+                    typedef Page page;
+
+                    struct padded_page : Page
+                    {
+                        padded_page();
+                        void operator=(const padded_page&);
+                        T last;
+                    };
+
+                    const size_t my_items_per_page;
+
+                    concurrent_queue_page_source() :
+                        my_items_per_page(concurrent_queue_rep_base::default_items_per_page(sizeof(T)))
+                    {}
+
+                    virtual ~concurrent_queue_page_source() {}
+
+                    size_t page_size() const
+                    {
+                        return sizeof(padded_page) + (my_items_per_page-1)*sizeof(T);
+                    }
+
+                    page* allocate_page()
+                    {
+                        page* p = reinterpret_cast<page*>(allocate_block(page_size()));
+                        p->next = NULL;
+                        p->mask = 0;
+                        return p;
+                    }
+
+                    void deallocate_page(page* p)
+                    {
+                        deallocate_block(reinterpret_cast<void*>(p), page_size());
+                    }
+
+                    static T& get_ref(page& p, size_t index)
+                    {
+                        return (&static_cast<padded_page*>(static_cast<void*>(&p))->last)[index];
+                    }
+
+                private:
+                    // Custom allocator
+                    virtual void* allocate_block(size_t n) = 0;
+
+                    // Custom de-allocator
+                    virtual void deallocate_block(void* p, size_t n) = 0;
+            };
+
+            /*
+             * Wait-free single producer, single consumer queue
+             *
+             * A chain of fixed size pages used as ring segments: the producer writes the slot
+             * after the last published item and publishes it with a release store of
+             * tail_counter, the consumer reads up to the tail it last saw and only reloads it
+             * when it catches up. Neither side executes a read-modify-write on the fast path.
+             * Drained pages go back to the producer through a page_pool, so a steady stream
+             * runs on a few pages without calling the allocator.
+             */
+            template <typename T>
+            class spsc_queue_base : public concurrent_queue_page_source<T>
+            {
+                typedef typename micro_queue<T>::item_constructor_t item_constructor_t;
+                typedef typename micro_queue<T>::item_mover_t item_mover_t;
+                typedef concurrent_queue_rep_base::page page;
+
+                // Producer side
+                page* my_tail_page;
+                atomic<ticket> my_tail_counter;
+                char pad1[NFS_MaxLineSize-sizeof(page*)-sizeof(atomic<ticket>)];
+
+                // Consumer side
+                page* my_head_page;
+                ticket my_cached_tail;
+                atomic<ticket> my_head_counter;
+                char pad2[NFS_MaxLineSize-sizeof(page*)-sizeof(ticket)-sizeof(atomic<ticket>)];
+
+                // Drained pages handed back to the producer
+                page_pool<page> my_free_pages;
+
+                // Page before the first one, so that neither side has to special case an empty chain
+                page my_anchor;
+
+                void release_page(page* p)
+                {
+                    if (p == &my_anchor) return;
+                    if (!my_free_pages.put(p))
+                    {
+                        this->deallocate_page(p);
+                    }
+                }
+
+                protected:
+                    spsc_queue_base()
+                    {
+                        my_anchor.next = NULL;
+                        my_anchor.mask = 0;
+                        my_tail_page = my_head_page = &my_anchor;
+                        my_tail_counter = 0;
+                        my_head_counter = 0;
+                        my_cached_tail = 0;
+                        my_free_pages.init();
+                    }
+
+                    // Free the pages once the queue is empty; called by the derived destructor, which owns the allocator
+                    void internal_finish_clear()
+                    {
+                        __TBB_ASSERT(my_tail_counter == my_head_counter, "items were not destroyed");
+                        for (page* p = my_head_page; p; )
+                        {
+                            page* next = p->next;
+                            if (p != &my_anchor) this->deallocate_page(p);
+                            p = next;
+                        }
+                        while (page* p = my_free_pages.take()) this->deallocate_page(p);
+                        my_tail_page = my_head_page = &my_anchor;
+                        my_anchor.next = NULL;
+                    }
+
+                    // Producer thread only
+                    void internal_push(const void* src, item_constructor_t construct_item)
+                    {
+                        ticket k = my_tail_counter.template load<relaxed>();
+                        size_t index = modulo_power_of_two(k, this->my_items_per_page);
+                        if (index)
+                        {
+                            construct_item(&this->get_ref(*my_tail_page, index), src);
+                        }
+                        else
+                        {
+                            page* p = my_free_pages.take();
+                            if (p)
+                            {
+                                p->next = NULL;
+                            }
+                            else
+                            {
+                                p = this->allocate_page();
+                            }
+                            __TBB_TRY {
+                                construct_item(&this->get_ref(*p, 0), src);
+                            } __TBB_CATCH(...) {
+                                release_page(p);
+                                __TBB_RETHROW();
+                            }
+                            // The page is linked before its first item is published
+                            my_tail_page->next = p;
+                            my_tail_page = p;
+                        }
+                        my_tail_counter.template store<release>(k+1);
+                    }
+
+                    // Consumer thread only
+                    bool internal_try_pop(void* dst, item_mover_t move_item = move_assign_popped_item<T>)
+                    {
+                        ticket k = my_head_counter.template load<relaxed>();
+                        if (k == my_cached_tail)
+                        {
+                            my_cached_tail = my_tail_counter.template load<acquire>();
+                            if (k == my_cached_tail) return false;
+                        }
+                        size_t index = modulo_power_of_two(k, this->my_items_per_page);
+                        if (!index)
+                        {
+                            page* drained = my_head_page;
+                            my_head_page = drained->next;
+                            release_page(drained);
+                        }
+                        T& item = this->get_ref(*my_head_page, index);
+                        my_head_counter.template store<release>(k+1);
+                        move_and_destroy_item(dst, item, move_item);
+                        return true;
+                    }
+
+                    size_t internal_size() const
+                    {
+                        ticket hc = my_head_counter;
+                        return size_t(my_tail_counter-hc);
+                    }
+
+                    bool internal_empty() const
+                    {
+                        return my_tail_counter == my_head_counter;
+                    }
+            };
+
+            // Page of mpsc_queue_base; mask holds the slots whose push has finished
+            struct mpsc_page : concurrent_queue_rep_base::page
+            {
+                mpsc_page* prev;
+                ticket number;
+                // Slots whose construction threw, set before their mask bit
+                uintptr_t invalid;
+            };
+
+            /*
+             * Multiple producer, single consumer queue over linked pages
+             *
+             * Producers take tickets with one fetch_and_add and never wait for each other's
+             * items: ticket k goes to slot k%items_per_page of page k/items_per_page, and a push
+             * publishes its slot by setting the slot's bit in the page mask. The producer that
+             * gets slot 0 allocates and links the page after the previous one; the others wait
+             * only for that link and find their page by walking back from the last linked page.
+             * Such a walk only touches pages with an unpublished slot at or before its own,
+             * which the consumer cannot have freed yet.
+             *
+             * The consumer takes items in ticket order with plain loads of the mask. Drained
+             * pages go to a page_pool for the next linking producers, or are freed when the pool
+             * is full. If a page allocation fails the queue stops growing: further
+             * pushes throw and the consumer sees the queue end there.
+             */
+            template <typename T>
+            class mpsc_queue_base : public concurrent_queue_page_source<T, mpsc_page>
+            {
+                typedef typename micro_queue<T>::item_constructor_t item_constructor_t;
+                typedef typename micro_queue<T>::item_mover_t item_mover_t;
+                typedef mpsc_page page;
+
+                // Producer side
+                atomic<ticket> my_tail_counter;
+                char pad1[NFS_MaxLineSize-sizeof(atomic<ticket>)];
+
+                // Last linked page and the number of linked pages, written by the linking producers
+                atomic<page*> my_last_page;
+                atomic<ticket> my_pages_linked;
+                atomic<uintptr_t> my_failed;
+                char pad2[NFS_MaxLineSize-sizeof(atomic<page*>)-sizeof(atomic<ticket>)-sizeof(atomic<uintptr_t>)];
+
+                // Consumer side
+                page* my_head_page;
+                ticket my_head_counter;
+                char pad3[NFS_MaxLineSize-sizeof(page*)-sizeof(ticket)];
+
+                // Drained pages handed back to the producers
+                page_pool<page> my_free_pages;
+
+                // Page before page 0
+                page my_anchor;
+
+                void release_page(page* p)
+                {
+                    if (p == &my_anchor) return;
+                    if (!my_free_pages.put(p))
+                    {
+                        this->deallocate_page(p);
+                    }
+                }
+
+                // Wait until page pn is linked and return it
+                page* find_page(ticket pn)
+                {
+                    for (atomic_backoff b; my_pages_linked <= pn; b.pause())
+                    {
+                        if (my_failed) throw_exception(eid_bad_last_alloc);
+                    }
+                    page* p = my_last_page;
+                    while (p->number != pn) p = p->prev;
+                    return p;
+                }
+
+                // Allocate page pn and link it once page pn-1 is linked
+                page* link_page(ticket pn)
+                {
+                    page* p = my_free_pages.take();
+                    if (p)
+                    {
+                        p->next = NULL;
+                        p->mask = 0;
+                    }
+                    else
+                    {
+                        __TBB_TRY {
+                            p = this->allocate_page();
+                        } __TBB_CATCH(...) {
+                            my_failed = 1;
+                            __TBB_RETHROW();
+                        }
+                    }
+                    p->number = pn;
+                    p->invalid = 0;
+                    for (atomic_backoff b; my_pages_linked != pn; b.pause())
+                    {
+                        if (my_failed)
+                        {
+                            release_page(p);
+                            throw_exception(eid_bad_last_alloc);
+                        }
+                    }
+                    page* prev = my_last_page;
+                    p->prev = prev;
+                    itt_store_word_with_release(prev->next, static_cast<concurrent_queue_rep_base::page*>(p));
+                    my_last_page = p;
+                    my_pages_linked = pn+1;
+                    return p;
+                }
+
+                // Push src[0..n) (or invalid entries for a null src) at tickets [k,k+n) of one page
+                void fill_slots(ticket k, size_t n, const T* src, item_constructor_t construct_item)
+                {
+                    ticket pn = k/this->my_items_per_page;
+                    size_t index = modulo_power_of_two(k, this->my_items_per_page);
+                    page* p = index ? find_page(pn) : link_page(pn);
+                    uintptr_t bits = (n < 8*sizeof(uintptr_t) ? (uintptr_t(1)<<n)-1 : ~uintptr_t(0)) << index;
+                    size_t i = 0;
+                    __TBB_TRY {
+                        if (src)
+                        {
+                            for (; i < n; ++i)
+                            {
+                                construct_item(&this->get_ref(*p, index+i), src+i);
+                            }
+                        }
+                    } __TBB_CATCH(...) {
+                        __TBB_AtomicOR(&p->invalid, bits & ~((uintptr_t(1)<<(index+i))-1));
+                        __TBB_AtomicOR(&p->mask, bits);
+                        __TBB_RETHROW();
+                    }
+                    if (i < n) __TBB_AtomicOR(&p->invalid, bits);
+                    __TBB_AtomicOR(&p->mask, bits);
+                }
+
+                protected:
+                    mpsc_queue_base()
+                    {
+                        my_anchor.next = NULL;
+                        my_anchor.mask = 0;
+                        my_anchor.prev = NULL;
+                        my_anchor.number = ticket(-1);
+                        my_anchor.invalid = 0;
+                        my_tail_counter = 0;
+                        my_last_page = &my_anchor;
+                        my_pages_linked = 0;
+                        my_failed = 0;
+                        my_free_pages.init();
+                        my_head_page = &my_anchor;
+                        my_head_counter = 0;
+                    }
+
+                    // Free the pages once the queue is empty; called by the derived destructor, which owns the allocator
+                    void internal_finish_clear()
+                    {
+                        for (concurrent_queue_rep_base::page* p = my_head_page; p; )
+                        {
+                            concurrent_queue_rep_base::page* next = p->next;
+                            if (p != &my_anchor) this->deallocate_page(static_cast<page*>(p));
+                            p = next;
+                        }
+                        while (page* p = my_free_pages.take()) this->deallocate_page(p);
+                        my_anchor.next = NULL;
+                        my_last_page = my_head_page = &my_anchor;
+                        my_pages_linked = 0;
+                        my_tail_counter = my_head_counter = 0;
+                    }
+
+                    /*
+                     * Enqueue src[0..n) at consecutive tickets; may run on any thread
+                     *
+                     * One fetch_and_add reserves the range and every page of it is published
+                     * with one atomic or. If constructing an item throws, it and the rest of
+                     * the range become invalid entries that the consumer skips.
+                     */
+                    void internal_push_n(const T* src, size_t n, item_constructor_t construct_item)
+                    {
+                        if (!n) return;
+                        ticket k = my_tail_counter.fetch_and_add(n);
+                        ticket end = k+n;
+                        size_t count;
+                        __TBB_TRY {
+                            for (; k < end; k += count, src += count)
+                            {
+                                count = this->my_items_per_page - modulo_power_of_two(k, this->my_items_per_page);
+                                if (count > end-k) count = size_t(end-k);
+                                fill_slots(k, count, src, construct_item);
+                            }
+                        } __TBB_CATCH(...) {
+                            // The tickets are taken, the consumer must be able to move past them
+                            for (k += count; k < end && !my_failed; k += count)
+                            {
+                                count = this->my_items_per_page - modulo_power_of_two(k, this->my_items_per_page);
+                                if (count > end-k) count = size_t(end-k);
+                                __TBB_TRY {
+                                    fill_slots(k, count, NULL, construct_item);
+                                } __TBB_CATCH(...) {}
+                            }
+                            __TBB_RETHROW();
+                        }
+                    }
+
+                    void internal_push(const void* src, item_constructor_t construct_item)
+                    {
+                        internal_push_n(static_cast<const T*>(src), 1, construct_item);
+                    }
+
+                    // Consumer thread only
+                    bool internal_try_pop(void* dst, item_mover_t move_item = move_assign_popped_item<T>)
+                    {
+                        for (;;)
+                        {
+                            ticket k = my_head_counter;
+                            page* p = my_head_page;
+                            if (p->number != k/this->my_items_per_page)
+                            {
+                                page* next = static_cast<page*>(itt_load_word_with_acquire(p->next));
+                                if (!next) return false;
+                                release_page(p);
+                                my_head_page = p = next;
+                            }
+                            uintptr_t bit = uintptr_t(1) << modulo_power_of_two(k, this->my_items_per_page);
+                            if (!(__TBB_load_with_acquire(p->mask) & bit)) return false;
+                            my_head_counter = k+1;
+                            if (p->invalid & bit) continue;
+                            move_and_destroy_item(dst, this->get_ref(*p, modulo_power_of_two(k, this->my_items_per_page)), move_item);
+                            return true;
+                        }
+                    }
+
+                    // Number of items; consumer thread only, and only approximate while pushes run
+                    size_t internal_size() const
+                    {
+                        return size_t(my_tail_counter-my_head_counter);
+                    }
+
+                    // Consumer thread only
+                    bool internal_empty() const
+                    {
+                        ticket k = my_head_counter;
+                        const page* p = my_head_page;
+                        if (p->number != k/this->my_items_per_page)
+                        {
+                            p = static_cast<const page*>(itt_load_word_with_acquire(p->next));
+                            if (!p) return true;
+                        }
+                        return !(__TBB_load_with_acquire(p->mask) & uintptr_t(1) << modulo_power_of_two(k, this->my_items_per_page));
+                    }
+            };
+
+            /*
+             * Allocator side of a public queue, layered over the queue implementation Base
+             *
+             * The pages (or items) Base asks for through allocate_block/deallocate_block come
+             * from A rebound to char, and copy_construct_item/move_construct_item are the item
+             * constructors the push operations hand to Base. The memory is owned through Base,
+             * a copy would free it twice, so the queues built on this are not copyable.
+             */
+            template <typename Base, typename T, typename A>
+            class queue_allocator_base : public Base
+            {
+                queue_allocator_base(const queue_allocator_base&);
+                queue_allocator_base& operator=(const queue_allocator_base&);
+
+                void* allocate_block(size_t n) __TBB_override
+                {
+                    void* b = reinterpret_cast<void*>(my_allocator.allocate(n));
+                    if (!b)
+                        throw_exception(eid_bad_alloc);
+                    return b;
+                }
+
+                void deallocate_block(void* b, size_t n) __TBB_override
+                {
+                    my_allocator.deallocate(reinterpret_cast<char*>(b), n);
+                }
+
+                protected:
+                    typedef typename A::template rebind<char>::other page_allocator_type;
+                    page_allocator_type my_allocator;
+
+                    explicit queue_allocator_base(const A& a) : my_allocator(a) {}
+
+                    // The arguments in front of the allocator go to the constructor of Base
+                    template <typename A1>
+                    queue_allocator_base(A1 a1, const A& a) : Base(a1), my_allocator(a) {}
+
+                    template <typename A1, typename A2, typename A3>
+                    queue_allocator_base(A1 a1, A2 a2, A3 a3, const A& a) : Base(a1, a2, a3), my_allocator(a) {}
+
+                    static void copy_construct_item(T* location, const void* src)
+                    {
+                        new(location) T(*static_cast<const T*>(src));
+                    }
+
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+                    static void move_construct_item(T* location, const void* src)
+                    {
+                        new(location) T(std::move(*static_cast<T*>(const_cast<void*>(src))));
+                    }
+#endif
+            };
         }
     } 
 }
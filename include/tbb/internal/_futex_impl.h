@@ -0,0 +1,220 @@
+/*
+ * _futex_impl.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_INTERNAL__FUTEX_IMPL_H_
+#define INCLUDE_TBB_INTERNAL__FUTEX_IMPL_H_
+
+#include "../tbb_stddef.h"
+#include "../tbb_machine.h"
+#include "../atomic.h"
+#include "../tick_count.h"
+
+#if __linux__
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <climits>
+#define __TBB_USE_FUTEX 1
+#else
+#define __TBB_USE_FUTEX 0
+#endif
+
+namespace tbb {
+namespace internal {
+
+__TBB_STATIC_ASSERT(sizeof(atomic<int>) == sizeof(int), "a futex word must be a plain int");
+
+/*
+ * Sleep while word == expected; may return spuriously
+ *
+ * Without futexes (other than Linux) the thread only yields, so callers
+ * must always recheck their condition.
+ */
+inline void futex_wait(atomic<int>& word, int expected) {
+#if __TBB_USE_FUTEX
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, NULL, NULL, 0);
+#else
+	if (word == expected)
+		__TBB_Yield();
+#endif
+}
+
+// Sleep while word == expected, at most nanoseconds; may return early
+inline void futex_wait_for(atomic<int>& word, int expected, long long nanoseconds) {
+#if __TBB_USE_FUTEX
+	struct timespec timeout;
+	timeout.tv_sec = time_t(nanoseconds/1000000000);
+	timeout.tv_nsec = long(nanoseconds%1000000000);
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, &timeout, NULL, 0);
+#else
+	suppress_unused_warning(nanoseconds);
+	if (word == expected)
+		__TBB_Yield();
+#endif
+}
+
+// Wake all threads sleeping in futex_wait on word
+inline void futex_wake_all(atomic<int>& word) {
+#if __TBB_USE_FUTEX
+	syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+	suppress_unused_warning(word);
+#endif
+}
+
+/*
+ * Spin budget shared by the waiters of one object
+ *
+ * A wait that ends while spinning doubles the budget, one that has to park halves it.
+ * Under bursty load waiters stay on the CPU across short gaps and stop burning it once
+ * the gaps get long. The backoff yields once it is long, which lets the thread that will
+ * end the wait run on an oversubscribed machine.
+ */
+class adaptive_spin : no_copy {
+	static const int max_rounds = 64;
+
+	const int my_min_rounds;
+	// Backoff rounds a waiter spins before it parks
+	atomic<int> my_rounds;
+
+public:
+	explicit adaptive_spin(int min_rounds = 2) : my_min_rounds(min_rounds) {my_rounds = min_rounds;}
+
+	// Spin on pred() for the current budget and adapt the budget to the outcome
+	template <typename Predicate>
+	bool operator()(const Predicate& pred) {
+		int rounds = my_rounds;
+		atomic_backoff backoff;
+		for (int i = 0; i < rounds; ++i) {
+			if (pred()) {
+				if (rounds < max_rounds)
+					my_rounds = 2*rounds;
+				return true;
+			}
+			backoff.pause();
+		}
+		if (rounds > my_min_rounds)
+			my_rounds = rounds/2 > my_min_rounds ? rounds/2 : my_min_rounds;
+		return pred();
+	}
+};
+
+/*
+ * Event count for parking threads until a condition on some other atomic holds
+ *
+ * A waiter calls prepare_wait(), checks its condition, and then either cancel_wait()
+ * or commit_wait() with the epoch it got. A notifier changes the condition with an
+ * atomic read-modify-write and then calls notify_all(). The waiter count is bumped
+ * before the condition is checked, so a notifier either sees the waiter or the waiter
+ * sees the new condition; notify_all() without waiters costs a single load.
+ * Nothing is allocated per waiter.
+ *
+ * wait() and wait_for() wrap the protocol for a predicate and spin before parking,
+ * for the budget of an adaptive_spin.
+ */
+class futex_event : no_copy {
+	atomic<int> my_epoch;
+	atomic<int> my_waiters;
+	adaptive_spin my_spin;
+
+public:
+	futex_event() {
+		my_epoch = 0;
+		my_waiters = 0;
+	}
+
+	int prepare_wait() {
+		my_waiters.fetch_and_increment();
+		return my_epoch;
+	}
+
+	void cancel_wait() {
+		my_waiters.fetch_and_decrement();
+	}
+
+	// Sleep unless a notification came after prepare_wait(); may return spuriously
+	void commit_wait(int epoch) {
+		futex_wait(my_epoch, epoch);
+		my_waiters.fetch_and_decrement();
+	}
+
+	// As commit_wait(), but sleep at most nanoseconds
+	void commit_wait_for(int epoch, long long nanoseconds) {
+		futex_wait_for(my_epoch, epoch, nanoseconds);
+		my_waiters.fetch_and_decrement();
+	}
+
+	// Return once pred() holds; it must be made true by a thread that calls notify_all() afterwards
+	template <typename Predicate>
+	void wait(const Predicate& pred) {
+		if (my_spin(pred)) return;
+		while (!pred()) {
+			int epoch = prepare_wait();
+			if (pred()) {
+				cancel_wait();
+				return;
+			}
+			commit_wait(epoch);
+		}
+	}
+
+	// As wait(), but give up after timeout; returns pred()
+	template <typename Predicate>
+	bool wait_for(const Predicate& pred, const tick_count::interval_t& timeout) {
+		if (my_spin(pred)) return true;
+		tick_count start = tick_count::now();
+		for (;;) {
+			double left = timeout.seconds() - (tick_count::now() - start).seconds();
+			if (left <= 0)
+				return pred();
+			int epoch = prepare_wait();
+			if (pred()) {
+				cancel_wait();
+				return true;
+			}
+			commit_wait_for(epoch, static_cast<long long>(left*1E9) + 1);
+			if (pred())
+				return true;
+		}
+	}
+
+	void notify_all() {
+		if (my_waiters) {
+			my_epoch.fetch_and_increment();
+			futex_wake_all(my_epoch);
+		}
+	}
+};
+
+/*
+ * futex_events for waiters on numbered tickets, spread over N buckets
+ *
+ * A waiter for ticket k parks on bucket k % N, so the thread that makes ticket k
+ * ready wakes only the waiters whose tickets share its bucket instead of all of them.
+ */
+template <size_t N>
+class futex_event_buckets : no_copy {
+	futex_event my_events[N];
+public:
+	futex_event& operator[](size_t k) {return my_events[k % N];}
+
+	// Wake the waiters for tickets [first,first+n)
+	void notify(size_t first, size_t n) {
+		if (n > N) n = N;
+		for (size_t i = 0; i < n; ++i)
+			my_events[(first + i) % N].notify_all();
+	}
+
+	void notify_all() {
+		for (size_t i = 0; i < N; ++i)
+			my_events[i].notify_all();
+	}
+};
+
+}
+}
+
+#endif /* INCLUDE_TBB_INTERNAL__FUTEX_IMPL_H_ */
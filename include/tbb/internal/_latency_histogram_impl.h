@@ -0,0 +1,57 @@
+/*
+ * _latency_histogram_impl.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_INTERNAL__LATENCY_HISTOGRAM_IMPL_H_
+#define INCLUDE_TBB_INTERNAL__LATENCY_HISTOGRAM_IMPL_H_
+
+#include "../tbb_stddef.h"
+#include "../atomic.h"
+#include "../tick_count.h"
+
+namespace tbb {
+namespace internal {
+
+/*
+ * Durations counted over powers of two nanoseconds
+ *
+ * Bucket i counts durations of [2^i, 2^(i+1)) ns; the first and last buckets are open
+ * ended. A record costs a clock read and an atomic add. The counters may live in raw
+ * memory, so init() zeroes them instead of a constructor.
+ */
+class latency_histogram : no_copy {
+public:
+	static const size_t buckets = 40;
+
+	void init() {
+		for (size_t i = 0; i < buckets; ++i) my_counts[i] = 0;
+	}
+
+	// Count the time from start until now
+	void record(const tick_count& start) {
+		double ns = (tick_count::now() - start).seconds()*1E9;
+		size_t bucket = 0;
+		for (double bound = 2; ns >= bound && bucket+1 < buckets; bound *= 2) ++bucket;
+		my_counts[bucket].fetch_and_increment();
+	}
+
+	// Copy the buckets to counts[0..buckets); returns their sum
+	size_t copy_to(size_t* counts) const {
+		size_t total = 0;
+		for (size_t i = 0; i < buckets; ++i) {
+			counts[i] = my_counts[i];
+			total += counts[i];
+		}
+		return total;
+	}
+
+private:
+	atomic<size_t> my_counts[buckets];
+};
+
+}
+}
+
+#endif /* INCLUDE_TBB_INTERNAL__LATENCY_HISTOGRAM_IMPL_H_ */
@@ -0,0 +1,213 @@
+/*
+ * _parallel_chunk_impl.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_INTERNAL__PARALLEL_CHUNK_IMPL_H_
+#define INCLUDE_TBB_INTERNAL__PARALLEL_CHUNK_IMPL_H_
+
+#include "../tbb_stddef.h"
+#include "../atomic.h"
+#include "../tbb_exception.h"
+#include "../tbb_thread.h"
+#include "_futex_impl.h"
+#include <new>
+
+#if __TBB_EXCEPTION_PTR_PRESENT
+#include <exception>
+#endif
+
+namespace tbb {
+namespace internal {
+
+/*
+ * Helper threads shared by every parallel_chunk_invoke of the process
+ *
+ * They are started on first use, one fewer than the hardware threads, and park on a
+ * futex_event while idle, so a bulk operation only pays for waking them. One call at a
+ * time owns the helpers and lets at most one of them in per chunk beyond its own; a call
+ * that finds them owned, for instance one nested in a chunk of another, runs on its own thread.
+ */
+class chunk_worker_pool : no_copy {
+public:
+	// Work offered to the helpers; run() returns once no chunk is left to claim and never throws
+	class job {
+	public:
+		virtual void run() = 0;
+	protected:
+		~job() {}
+	};
+
+private:
+	atomic<uintptr_t> my_owned;
+	atomic<job*> my_job;
+	// Helpers that may still join my_job
+	atomic<intptr_t> my_slots;
+	// Helpers between seeing a new job and leaving it
+	atomic<size_t> my_active;
+	atomic<int> my_generation;
+	futex_event my_wakeups;
+	size_t my_n_helpers;
+
+	class helper {
+		chunk_worker_pool* my_pool;
+	public:
+		helper(chunk_worker_pool& pool) : my_pool(&pool) {}
+		void operator()() const {my_pool->serve();}
+	};
+
+	class generation_changed {
+		const chunk_worker_pool& my_pool;
+		const int my_seen;
+	public:
+		generation_changed(const chunk_worker_pool& pool, int seen) : my_pool(pool), my_seen(seen) {}
+		bool operator()() const {return my_pool.my_generation != my_seen;}
+	};
+
+	chunk_worker_pool() : my_n_helpers(0) {
+		my_owned = 0;
+		my_job = NULL;
+		my_slots = 0;
+		my_active = 0;
+		my_generation = 0;
+	}
+
+	void start() {
+		size_t n_threads = tbb_thread::hardware_concurrency();
+		for (; my_n_helpers + 1 < n_threads; ++my_n_helpers) {
+			__TBB_TRY {
+				tbb_thread t(helper(*this));
+				t.detach();
+			} __TBB_CATCH(...) {
+				// Could not start all the helpers; the pool just gets smaller
+				break;
+			}
+		}
+	}
+
+	void serve() {
+		for (int seen = 0;;) {
+			my_wakeups.wait(generation_changed(*this, seen));
+			seen = my_generation;
+			// Counted before looking at the job, so the owner cannot retire it under us
+			my_active.fetch_and_increment();
+			job* j = my_job;
+			if (j && my_slots.fetch_and_decrement() > 0)
+				j->run();
+			my_active.fetch_and_decrement();
+		}
+	}
+
+public:
+	// The pool of the process; NULL while its first user is still starting it
+	static chunk_worker_pool* instance() {
+		static atomic<chunk_worker_pool*> the_pool;
+		static atomic<uintptr_t> the_start;
+		chunk_worker_pool* pool = the_pool;
+		if (!pool && the_start.compare_and_swap(1, 0) == 0) {
+			// The helpers never exit, so neither the pool nor its threads are ever released
+			pool = new (std::nothrow) chunk_worker_pool;
+			if (pool) {
+				pool->start();
+				the_pool = pool;
+			}
+		}
+		return pool;
+	}
+
+	// Run j on the calling thread and on up to max_helpers helpers, if they are free
+	void run(job& j, size_t max_helpers) {
+		if (!my_n_helpers || my_owned.compare_and_swap(1, 0) != 0) {
+			j.run();
+			return;
+		}
+		my_slots = intptr_t(max_helpers < my_n_helpers ? max_helpers : my_n_helpers);
+		my_job.fetch_and_store(&j);
+		my_generation.fetch_and_increment();
+		my_wakeups.notify_all();
+		j.run();
+		// A helper either counted itself before this exchange or will not find the job
+		my_job.fetch_and_store(NULL);
+		for (atomic_backoff backoff; my_active; backoff.pause()) {}
+		my_owned = 0;
+	}
+};
+
+/*
+ * Fork-join helper used by containers for bulk operations (construction, copy, compaction).
+ *
+ * The index range [0,n) is cut into chunks of grainsize indices which the calling thread
+ * and the helpers of chunk_worker_pool claim one by one from a shared counter.
+ * Every chunk is run even after a failure, so the body can leave its data in a consistent
+ * state; the first exception is rethrown on the calling thread once every helper has left.
+ */
+template <typename Body>
+class parallel_chunk_team : public chunk_worker_pool::job, no_copy {
+	const Body& my_body;
+	const size_t my_size;
+	const size_t my_grainsize;
+	atomic<size_t> my_next;
+	atomic<uintptr_t> my_failed;
+#if __TBB_EXCEPTION_PTR_PRESENT
+	std::exception_ptr my_exception;
+#endif
+
+	void run() __TBB_override {
+		for (;;) {
+			size_t begin = my_next.fetch_and_add(my_grainsize);
+			if (begin >= my_size) return;
+			size_t end = my_size - begin < my_grainsize ? my_size : begin + my_grainsize;
+			__TBB_TRY {
+				my_body(begin, end);
+			} __TBB_CATCH(...) {
+				if (my_failed.fetch_and_store(1) == 0) {
+#if __TBB_EXCEPTION_PTR_PRESENT
+					my_exception = std::current_exception();
+#endif
+				}
+			}
+		}
+	}
+
+public:
+	parallel_chunk_team(size_t n, size_t grainsize, const Body& body) :
+		my_body(body), my_size(n), my_grainsize(grainsize ? grainsize : 1)
+	{
+		my_next.store<relaxed>(0);
+		my_failed.store<relaxed>(0);
+	}
+
+	void execute() {
+		size_t n_chunks = (my_size + my_grainsize - 1)/my_grainsize;
+		chunk_worker_pool* pool = n_chunks > 1 ? chunk_worker_pool::instance() : NULL;
+		if (pool)
+			pool->run(*this, n_chunks - 1);
+		else
+			run();
+		if (my_failed) {
+#if __TBB_EXCEPTION_PTR_PRESENT
+			std::rethrow_exception(my_exception);
+#else
+			throw_exception(eid_user_abort);
+#endif
+		}
+	}
+};
+
+// Run body(begin,end) over [0,n) in chunks of grainsize indices on the calling thread and the shared helpers
+template <typename Body>
+void parallel_chunk_invoke(size_t n, size_t grainsize, const Body& body) {
+	if (!n) return;
+	if (n <= grainsize) {
+		body(size_t(0), n);
+		return;
+	}
+	parallel_chunk_team<Body> team(n, grainsize, body);
+	team.execute();
+}
+
+}
+}
+
+#endif /* INCLUDE_TBB_INTERNAL__PARALLEL_CHUNK_IMPL_H_ */
@@ -0,0 +1,288 @@
+/*
+ * _simd_kernels_impl.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_INTERNAL__SIMD_KERNELS_IMPL_H_
+#define INCLUDE_TBB_INTERNAL__SIMD_KERNELS_IMPL_H_
+
+#include "../tbb_stddef.h"
+#include <cstring>
+
+/*
+ * The vector kernels are written with GCC vector extensions and compiled once per
+ * instruction set through target attributes, so the header needs no special flags.
+ * Other compilers and architectures get the scalar loops only.
+ */
+#if __GNUC__ >= 6 && !__clang__ && !__INTEL_COMPILER && (__x86_64__ || __i386__)
+#define __TBB_SIMD_KERNELS_X86 1
+#else
+#define __TBB_SIMD_KERNELS_X86 0
+#endif
+
+namespace tbb {
+namespace internal {
+namespace simd {
+
+enum isa_t {
+	isa_scalar,
+	isa_avx2,
+	isa_avx512
+};
+
+inline isa_t detect_isa() {
+#if __TBB_SIMD_KERNELS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return isa_avx512;
+	if (__builtin_cpu_supports("avx2"))
+		return isa_avx2;
+#endif
+	return isa_scalar;
+}
+
+// Instruction set used by the kernels, detected once per process
+inline isa_t current_isa() {
+	static const isa_t isa = detect_isa();
+	return isa;
+}
+
+// Element types the vector kernels handle; everything else takes the scalar loops
+template <typename T> struct is_vectorizable {static const bool value = false;};
+template <> struct is_vectorizable<signed char> {static const bool value = true;};
+template <> struct is_vectorizable<unsigned char> {static const bool value = true;};
+template <> struct is_vectorizable<short> {static const bool value = true;};
+template <> struct is_vectorizable<unsigned short> {static const bool value = true;};
+template <> struct is_vectorizable<int> {static const bool value = true;};
+template <> struct is_vectorizable<unsigned int> {static const bool value = true;};
+template <> struct is_vectorizable<long> {static const bool value = true;};
+template <> struct is_vectorizable<unsigned long> {static const bool value = true;};
+template <> struct is_vectorizable<long long> {static const bool value = true;};
+template <> struct is_vectorizable<unsigned long long> {static const bool value = true;};
+template <> struct is_vectorizable<float> {static const bool value = true;};
+template <> struct is_vectorizable<double> {static const bool value = true;};
+
+/*
+ * Scalar loops
+ */
+template <typename T>
+size_t scalar_find(const T* p, size_t n, T value) {
+	for (size_t i = 0; i < n; ++i)
+		if (p[i] == value) return i;
+	return n;
+}
+
+template <typename T>
+size_t scalar_count(const T* p, size_t n, T value) {
+	size_t count = 0;
+	for (size_t i = 0; i < n; ++i)
+		count += p[i] == value;
+	return count;
+}
+
+template <typename T>
+T scalar_min(const T* p, size_t n, T result) {
+	for (size_t i = 0; i < n; ++i)
+		if (p[i] < result) result = p[i];
+	return result;
+}
+
+template <typename T>
+T scalar_max(const T* p, size_t n, T result) {
+	for (size_t i = 0; i < n; ++i)
+		if (result < p[i]) result = p[i];
+	return result;
+}
+
+template <typename T>
+T scalar_sum(const T* p, size_t n, T result) {
+	for (size_t i = 0; i < n; ++i)
+		result += p[i];
+	return result;
+}
+
+#if __TBB_SIMD_KERNELS_X86
+
+// Lane type of vector sums: signed lanes add as unsigned, so overflow wraps instead of being undefined
+template <typename T> struct sum_lane {typedef T type;};
+template <> struct sum_lane<signed char> {typedef unsigned char type;};
+template <> struct sum_lane<short> {typedef unsigned short type;};
+template <> struct sum_lane<int> {typedef unsigned int type;};
+template <> struct sum_lane<long> {typedef unsigned long type;};
+template <> struct sum_lane<long long> {typedef unsigned long long type;};
+
+#define __TBB_SIMD_INLINE inline __attribute__((always_inline))
+
+/*
+ * Vector kernels for Bytes wide registers
+ *
+ * They are always inlined into the per instruction set entry points below,
+ * which is where the code is actually generated for AVX2 or AVX-512.
+ */
+template <typename T, size_t Bytes>
+struct kernels {
+	typedef T vector_type __attribute__((vector_size(Bytes)));
+	static const size_t lanes = Bytes/sizeof(T);
+	// Lane counters are as wide as T, so count blocks must not overflow a signed lane
+	static const size_t count_block = sizeof(T) >= 4 ? size_t(1)<<20 : (size_t(1)<<(8*sizeof(T)-1)) - 1;
+
+	typedef typename sum_lane<T>::type sum_type;
+	typedef sum_type sum_vector_type __attribute__((vector_size(Bytes)));
+
+	// Vectors are passed by reference only, the helpers are compiled without the target's ABI
+	template <typename V>
+	static __TBB_SIMD_INLINE void load(V& v, const void* p) {
+		std::memcpy(&v, p, sizeof(v));
+	}
+
+	static __TBB_SIMD_INLINE void broadcast(vector_type& v, T value) {
+		for (size_t l = 0; l < lanes; ++l) v[l] = value;
+	}
+
+	template <typename M>
+	static __TBB_SIMD_INLINE bool any(const M& mask) {
+		unsigned long long words[Bytes/8];
+		std::memcpy(words, &mask, sizeof(words));
+		unsigned long long result = 0;
+		for (size_t w = 0; w < Bytes/8; ++w) result |= words[w];
+		return result != 0;
+	}
+
+	static __TBB_SIMD_INLINE size_t find(const T* p, size_t n, T value) {
+		vector_type v, x0, x1, x2, x3;
+		broadcast(v, value);
+		size_t m = n - n%(4*lanes);
+		for (size_t i = 0; i < m; i += 4*lanes) {
+			load(x0, p+i);
+			load(x1, p+i+lanes);
+			load(x2, p+i+2*lanes);
+			load(x3, p+i+3*lanes);
+			if (any((x0 == v) | (x1 == v) | (x2 == v) | (x3 == v)))
+				return i + scalar_find(p+i, 4*lanes, value);
+		}
+		return m + scalar_find(p+m, n-m, value);
+	}
+
+	static __TBB_SIMD_INLINE size_t count(const T* p, size_t n, T value) {
+		vector_type v, x;
+		broadcast(v, value);
+		size_t m = n - n%lanes;
+		size_t result = 0;
+		for (size_t i = 0; i < m;) {
+			size_t block_end = m - i > count_block*lanes ? i + count_block*lanes : m;
+			// Comparisons yield -1 per matching lane
+			typedef __typeof__(v == v) mask_type;
+			mask_type counters = mask_type();
+			for (; i < block_end; i += lanes) {
+				load(x, p+i);
+				counters -= x == v;
+			}
+			for (size_t l = 0; l < lanes; ++l)
+				result += size_t(counters[l]);
+		}
+		return result + scalar_count(p+m, n-m, value);
+	}
+
+	static __TBB_SIMD_INLINE T min(const T* p, size_t n, T init) {
+		size_t m = n - n%lanes;
+		vector_type acc, x;
+		broadcast(acc, init);
+		for (size_t i = 0; i < m; i += lanes) {
+			load(x, p+i);
+			acc = x < acc ? x : acc;
+		}
+		T result = init;
+		for (size_t l = 0; l < lanes; ++l)
+			if (acc[l] < result) result = acc[l];
+		return scalar_min(p+m, n-m, result);
+	}
+
+	static __TBB_SIMD_INLINE T max(const T* p, size_t n, T init) {
+		size_t m = n - n%lanes;
+		vector_type acc, x;
+		broadcast(acc, init);
+		for (size_t i = 0; i < m; i += lanes) {
+			load(x, p+i);
+			acc = acc < x ? x : acc;
+		}
+		T result = init;
+		for (size_t l = 0; l < lanes; ++l)
+			if (result < acc[l]) result = acc[l];
+		return scalar_max(p+m, n-m, result);
+	}
+
+	static __TBB_SIMD_INLINE T sum(const T* p, size_t n, T init) {
+		size_t m = n - n%lanes;
+		sum_vector_type acc = sum_vector_type(), x;
+		for (size_t i = 0; i < m; i += lanes) {
+			load(x, p+i);
+			acc += x;
+		}
+		sum_type result = sum_type(init);
+		for (size_t l = 0; l < lanes; ++l)
+			result += acc[l];
+		for (size_t i = m; i < n; ++i)
+			result += sum_type(p[i]);
+		return T(result);
+	}
+};
+
+#define __TBB_SIMD_ENTRY_POINTS(isa, target_string, bytes)                                      \
+	template <typename T> __attribute__((target(target_string)))                               \
+	size_t isa##_find(const T* p, size_t n, T value) {return kernels<T,bytes>::find(p, n, value);}  \
+	template <typename T> __attribute__((target(target_string)))                               \
+	size_t isa##_count(const T* p, size_t n, T value) {return kernels<T,bytes>::count(p, n, value);} \
+	template <typename T> __attribute__((target(target_string)))                               \
+	T isa##_min(const T* p, size_t n, T init) {return kernels<T,bytes>::min(p, n, init);}        \
+	template <typename T> __attribute__((target(target_string)))                               \
+	T isa##_max(const T* p, size_t n, T init) {return kernels<T,bytes>::max(p, n, init);}        \
+	template <typename T> __attribute__((target(target_string)))                               \
+	T isa##_sum(const T* p, size_t n, T init) {return kernels<T,bytes>::sum(p, n, init);}
+
+__TBB_SIMD_ENTRY_POINTS(avx2, "avx2", 32)
+__TBB_SIMD_ENTRY_POINTS(avx512, "avx512f,avx512bw", 64)
+
+#undef __TBB_SIMD_ENTRY_POINTS
+#undef __TBB_SIMD_INLINE
+
+#endif /* __TBB_SIMD_KERNELS_X86 */
+
+/*
+ * Entry points used by the containers: pick the widest instruction set the
+ * processor supports for element types the vector kernels know about.
+ */
+template <typename T, bool = is_vectorizable<T>::value && __TBB_SIMD_KERNELS_X86>
+struct dispatch {
+	static size_t find(const T* p, size_t n, T value) {return scalar_find(p, n, value);}
+	static size_t count(const T* p, size_t n, T value) {return scalar_count(p, n, value);}
+	static T min(const T* p, size_t n, T init) {return scalar_min(p, n, init);}
+	static T max(const T* p, size_t n, T init) {return scalar_max(p, n, init);}
+	static T sum(const T* p, size_t n, T init) {return scalar_sum(p, n, init);}
+};
+
+#if __TBB_SIMD_KERNELS_X86
+#define __TBB_SIMD_DISPATCH(op, p, n, arg)                   \
+	switch (current_isa()) {                                 \
+	case isa_avx512: return avx512_##op(p, n, arg);          \
+	case isa_avx2: return avx2_##op(p, n, arg);              \
+	default: return scalar_##op(p, n, arg);                  \
+	}
+
+template <typename T>
+struct dispatch<T, true> {
+	static size_t find(const T* p, size_t n, T value) {__TBB_SIMD_DISPATCH(find, p, n, value)}
+	static size_t count(const T* p, size_t n, T value) {__TBB_SIMD_DISPATCH(count, p, n, value)}
+	static T min(const T* p, size_t n, T init) {__TBB_SIMD_DISPATCH(min, p, n, init)}
+	static T max(const T* p, size_t n, T init) {__TBB_SIMD_DISPATCH(max, p, n, init)}
+	static T sum(const T* p, size_t n, T init) {__TBB_SIMD_DISPATCH(sum, p, n, init)}
+};
+
+#undef __TBB_SIMD_DISPATCH
+#endif
+
+}
+}
+}
+
+#endif /* INCLUDE_TBB_INTERNAL__SIMD_KERNELS_IMPL_H_ */
@@ -0,0 +1,325 @@
+/*
+ * parallel_sort.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_PARALLEL_SORT_H_
+#define INCLUDE_TBB_PARALLEL_SORT_H_
+
+#include "tbb_stddef.h"
+#include "tbb_exception.h"
+#include "tbb_thread.h"
+#include "concurrent_vector.h"
+#include "internal/_parallel_chunk_impl.h"
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include <new>
+
+namespace tbb {
+
+namespace internal {
+
+/*
+ * Merge sort on the segments of a concurrent_vector
+ *
+ * 1. The elements are cut into blocks that never cross a segment, and every block
+ *    is sorted in place with std::sort on plain pointers, one block per thread.
+ * 2. Adjacent sorted runs are merged pairwise, round after round, alternating between
+ *    the vector and one scratch buffer. Each round is split by output position
+ *    (merge path), so all threads take part even when only two runs are left.
+ *    A run of the last round that lands in the buffer is moved back the same way.
+ *    The split points of a round are all searched for before any element moves: a
+ *    search reads elements that another chunk of the round may be moving from.
+ *
+ * Element accesses go through cursors that only look up a segment when they cross
+ * into it. The merge is stable, but std::sort of the blocks is not, so neither is the sort.
+ */
+template <typename T, class A, typename Compare>
+class concurrent_vector_sorter : no_copy {
+	typedef concurrent_vector<T,A> vector_type;
+	typedef typename vector_type::size_type size_type;
+	typedef typename vector_type::allocator_type allocator_type;
+
+	// Elements of one side of a merge round: the vector segments or the flat buffer
+	class view {
+		const vector_type* my_vector;
+		T* my_flat;
+	public:
+		view(const vector_type* vector, T* flat) : my_vector(vector), my_flat(flat) {}
+		// Address of element i and the number of elements contiguous from it
+		T* run(size_type i, size_type& length) const {
+			if (my_flat) {
+				length = ~size_type(0) - i;
+				return my_flat + i;
+			}
+			return static_cast<T*>(vector_type::internal_element_run(*my_vector, i, sizeof(T), length));
+		}
+		T& operator[](size_type i) const {
+			size_type length;
+			return *run(i, length);
+		}
+	};
+
+	class cursor {
+		const view& my_view;
+		size_type my_index;
+		size_type my_left;
+		T* my_item;
+	public:
+		cursor(const view& v, size_type index) : my_view(v), my_index(index), my_left(0), my_item(NULL) {}
+		T& operator*() {
+			if (!my_left)
+				my_item = my_view.run(my_index, my_left);
+			return *my_item;
+		}
+		// Only after operator*
+		void advance() {
+			++my_index;
+			if (--my_left) ++my_item;
+		}
+		size_type index() const {return my_index;}
+	};
+
+	// Sorts blocks [begin,end) of my_bounds
+	class sort_body : internal::no_assign {
+		const concurrent_vector_sorter& my_sorter;
+	public:
+		sort_body(const concurrent_vector_sorter& sorter) : my_sorter(sorter) {}
+		void operator()(size_type begin, size_type end) const {
+			for (; begin < end; ++begin) {
+				size_type first = my_sorter.my_bounds[begin], length;
+				T* array = static_cast<T*>(vector_type::internal_element_run(my_sorter.my_vector, first, sizeof(T), length));
+				__TBB_ASSERT(length >= my_sorter.my_bounds[begin+1] - first, "a block crosses a segment");
+				std::sort(array, array + (my_sorter.my_bounds[begin+1] - first), my_sorter.my_compare);
+			}
+		}
+	};
+
+	// Finds the split point of the merge round at the start of chunks [begin,end), see co_rank
+	class rank_body : internal::no_assign {
+		const concurrent_vector_sorter& my_sorter;
+		const view& my_src;
+		size_type* const my_ranks;
+		const size_type my_grainsize;
+	public:
+		rank_body(const concurrent_vector_sorter& sorter, const view& src, size_type* ranks, size_type grainsize) :
+			my_sorter(sorter), my_src(src), my_ranks(ranks), my_grainsize(grainsize) {}
+		void operator()(size_type begin, size_type end) const {
+			for (; begin < end; ++begin) {
+				size_type k = begin*my_grainsize, lo, mid, hi;
+				my_sorter.find_merge(k, lo, mid, hi);
+				my_ranks[begin] = my_sorter.co_rank(my_src, lo, mid, hi, k - lo);
+			}
+		}
+	};
+
+	// Produces output positions [begin,end) of one merge round, one chunk of grainsize positions
+	class merge_body : internal::no_assign {
+		const concurrent_vector_sorter& my_sorter;
+		const view& my_src;
+		const view& my_dst;
+		const size_type* const my_ranks;
+		char* const my_done;
+		const size_type my_grainsize;
+	public:
+		merge_body(const concurrent_vector_sorter& sorter, const view& src, const view& dst, const size_type* ranks, char* done, size_type grainsize) :
+			my_sorter(sorter), my_src(src), my_dst(dst), my_ranks(ranks), my_done(done), my_grainsize(grainsize) {}
+		void operator()(size_type begin, size_type end) const {
+			size_type chunk = begin/my_grainsize;
+			cursor out(my_dst, begin);
+			__TBB_TRY {
+				while (out.index() < end) {
+					size_type lo, mid, hi;
+					my_sorter.find_merge(out.index(), lo, mid, hi);
+					// A merge that starts inside the chunk starts at its first elements
+					size_type i0 = out.index() == begin ? my_ranks[chunk] : 0;
+					// The chunk ends inside the merge where the next chunk starts, or with the merge
+					size_type k1 = hi - lo, i1 = mid - lo;
+					if (end < hi) {
+						k1 = end - lo;
+						i1 = my_ranks[chunk+1];
+					}
+					my_sorter.merge_part(my_src, lo, mid, out.index() - lo, i0, k1, i1, out, my_done != NULL);
+				}
+			} __TBB_CATCH(...) {
+				// In the constructing round a chunk either completes or leaves nothing behind
+				if (my_done)
+					for (size_type i = begin; i < out.index(); ++i)
+						my_dst[i].~T();
+				__TBB_RETHROW();
+			}
+			if (my_done)
+				my_done[begin/my_grainsize] = 1;
+		}
+	};
+
+	class destroy_body : internal::no_assign {
+		T* const my_array;
+	public:
+		destroy_body(T* array) : my_array(array) {}
+		void operator()(size_type begin, size_type end) const {
+			for (; begin < end; ++begin)
+				my_array[begin].~T();
+		}
+	};
+
+	vector_type& my_vector;
+	const Compare& my_compare;
+	const size_type my_size;
+	// Boundaries of the sorted runs: run r is [my_bounds[r], my_bounds[r+1])
+	std::vector<size_type> my_bounds;
+
+	// The merge of the round that produces output position k: runs [lo,mid) and [mid,hi)
+	void find_merge(size_type k, size_type& lo, size_type& mid, size_type& hi) const {
+		size_type runs = my_bounds.size() - 1;
+		size_type r = size_type(std::upper_bound(my_bounds.begin(), my_bounds.end(), k) - my_bounds.begin()) - 1;
+		r &= ~size_type(1);
+		lo = my_bounds[r];
+		mid = my_bounds[r+1 < runs ? r+1 : runs];
+		hi = my_bounds[r+2 < runs ? r+2 : runs];
+	}
+
+	// Number of elements of [lo,mid) among the first k outputs of merging [lo,mid) with [mid,hi)
+	size_type co_rank(const view& src, size_type lo, size_type mid, size_type hi, size_type k) const {
+		size_type la = mid - lo, lb = hi - mid;
+		size_type first = k > lb ? k - lb : 0, last = k < la ? k : la;
+		while (first < last) {
+			size_type i = first + (last - first)/2, j = k - i;
+			if (my_compare(src[mid+j-1], src[lo+i]))
+				last = i;
+			else
+				first = i + 1;
+		}
+		return first;
+	}
+
+	// Outputs [k0,k1) of merging [lo,mid) with [mid,hi), written at out; i0 and i1 are the co_ranks of k0 and k1
+	void merge_part(const view& src, size_type lo, size_type mid, size_type k0, size_type i0, size_type k1, size_type i1, cursor& out, bool construct) const {
+		size_type i = i0, j = k0 - i0, j1 = k1 - i1;
+		cursor a(src, lo + i), b(src, mid + j);
+		for (size_type k = k0; k < k1; ++k) {
+			bool take_a = i < i1 && (j == j1 || !my_compare(*b, *a));
+			cursor& c = take_a ? a : b;
+			T& item = *c;
+			if (construct)
+#if __TBB_CPP11_RVALUE_REF_PRESENT
+				new(&*out) T(std::move(item));
+			else
+				*out = std::move(item);
+#else
+				new(&*out) T(item);
+			else
+				*out = item;
+#endif
+			c.advance();
+			out.advance();
+			if (take_a) ++i; else ++j;
+		}
+	}
+
+	void merge_round(const view& src, const view& dst, size_type* ranks, char* done, size_type grainsize) {
+		size_type n_chunks = (my_size + grainsize - 1)/grainsize;
+		internal::parallel_chunk_invoke(n_chunks, 1, rank_body(*this, src, ranks, grainsize));
+		internal::parallel_chunk_invoke(my_size, grainsize, merge_body(*this, src, dst, ranks, done, grainsize));
+		std::vector<size_type> merged;
+		for (size_type r = 0; r < my_bounds.size(); r += 2)
+			merged.push_back(my_bounds[r]);
+		if (merged.back() != my_size)
+			merged.push_back(my_size);
+		my_bounds.swap(merged);
+	}
+
+public:
+	concurrent_vector_sorter(vector_type& vector, const Compare& compare) :
+		my_vector(vector), my_compare(compare), my_size(vector.size()) {}
+
+	void sort() {
+		if (my_size < 2) return;
+		size_type grainsize = size_type(vector_type::parallel_construction_grainsize)/sizeof(T);
+		if (!grainsize) grainsize = 1;
+		size_type n_threads = tbb_thread::hardware_concurrency();
+		size_type block = n_threads ? (my_size + n_threads - 1)/n_threads : my_size;
+		if (block < grainsize) block = grainsize;
+
+		// Blocks are cut at segment boundaries
+		for (size_type i = 0; i < my_size;) {
+			size_type length;
+			vector_type::internal_element_run(my_vector, i, sizeof(T), length);
+			size_type end = my_size - i < length ? my_size : i + length;
+			for (; i < end; i = end - i < block ? end : i + block)
+				my_bounds.push_back(i);
+		}
+		my_bounds.push_back(my_size);
+		internal::parallel_chunk_invoke(my_bounds.size() - 1, 1, sort_body(*this));
+		if (my_bounds.size() <= 2) return;
+
+		allocator_type allocator(my_vector.get_allocator());
+		T* buffer = allocator.allocate(my_size);
+		view vector_view(&my_vector, NULL), buffer_view(NULL, buffer);
+		size_type n_chunks = (my_size + grainsize - 1)/grainsize;
+		char* done = NULL;
+		std::vector<size_type> ranks;
+		__TBB_TRY {
+			done = new char[n_chunks]();
+			// Split points of a round, one per chunk
+			ranks.resize(n_chunks);
+			// The first round move constructs into the raw buffer
+			__TBB_TRY {
+				merge_round(vector_view, buffer_view, &ranks[0], done, grainsize);
+			} __TBB_CATCH(...) {
+				destroy_body destroy(buffer);
+				for (size_type c = 0; c < n_chunks; ++c) {
+					if (!done[c]) continue;
+					size_type begin = c*grainsize;
+					destroy(begin, my_size - begin < grainsize ? my_size : begin + grainsize);
+				}
+				__TBB_RETHROW();
+			}
+			__TBB_TRY {
+				bool in_buffer = true;
+				while (my_bounds.size() > 2 || in_buffer) {
+					merge_round(in_buffer ? buffer_view : vector_view, in_buffer ? vector_view : buffer_view, &ranks[0], NULL, grainsize);
+					in_buffer = !in_buffer;
+				}
+			} __TBB_CATCH(...) {
+				internal::parallel_chunk_invoke(my_size, grainsize, destroy_body(buffer));
+				__TBB_RETHROW();
+			}
+			internal::parallel_chunk_invoke(my_size, grainsize, destroy_body(buffer));
+		} __TBB_CATCH(...) {
+			delete[] done;
+			allocator.deallocate(buffer, my_size);
+			__TBB_RETHROW();
+		}
+		delete[] done;
+		allocator.deallocate(buffer, my_size);
+	}
+};
+
+}
+
+/*
+ * Sort the elements of a concurrent_vector on all hardware threads
+ *
+ * Works on the segments in place and needs one scratch buffer of size() elements for
+ * merging. Not thread-safe: the vector must not grow while it is being sorted.
+ * If a comparison or a move throws, the exception is propagated and the vector keeps
+ * its size, but some elements may be left in a moved-from state.
+ */
+template <typename T, class A, typename Compare>
+void parallel_sort(concurrent_vector<T,A>& vector, const Compare& comp) {
+	internal::concurrent_vector_sorter<T,A,Compare> sorter(vector, comp);
+	sorter.sort();
+}
+
+// Sort the elements of a concurrent_vector with operator<
+template <typename T, class A>
+void parallel_sort(concurrent_vector<T,A>& vector) {
+	parallel_sort(vector, std::less<T>());
+}
+
+}
+
+#endif /* INCLUDE_TBB_PARALLEL_SORT_H_ */
@@ -0,0 +1,146 @@
+/*
+ * simd_scan.h
+ *
+ *  Created on: Oct 19, 2026
+ */
+
+#ifndef INCLUDE_TBB_SIMD_SCAN_H_
+#define INCLUDE_TBB_SIMD_SCAN_H_
+
+#include "tbb_stddef.h"
+#include "internal/_template_helper.h"
+#include "internal/_simd_kernels_impl.h"
+
+namespace tbb {
+
+/*
+ * Vectorized scans over segmented ranges
+ *
+ * Work on any range with for_each_span(), i.e. concurrent_vector::range() and
+ * concurrent_soa_vector::column_range(). Every contiguous piece goes to a kernel
+ * for the widest instruction set found at run time (AVX-512, AVX2, or scalar loops),
+ * so per element segment lookups never reach the inner loop.
+ *
+ * Vector lanes are combined at the end: floating point sums may differ from a
+ * sequential sum in the last bits, and integer sums wrap like T arithmetic does.
+ */
+
+namespace internal {
+
+template <typename T>
+class simd_find_body : no_assign {
+	const T my_value;
+	size_t& my_offset;
+	bool& my_found;
+public:
+	simd_find_body(T value, size_t& offset, bool& found) : my_value(value), my_offset(offset), my_found(found) {}
+	void operator()(const T* p, size_t n) const {
+		if (my_found) return;
+		size_t i = simd::dispatch<T>::find(p, n, my_value);
+		my_offset += i;
+		my_found = i < n;
+	}
+};
+
+template <typename T>
+class simd_count_body : no_assign {
+	const T my_value;
+	size_t& my_count;
+public:
+	simd_count_body(T value, size_t& count) : my_value(value), my_count(count) {}
+	void operator()(const T* p, size_t n) const {my_count += simd::dispatch<T>::count(p, n, my_value);}
+};
+
+template <typename T>
+class simd_min_body : no_assign {
+	T& my_result;
+	bool& my_started;
+public:
+	simd_min_body(T& result, bool& started) : my_result(result), my_started(started) {}
+	void operator()(const T* p, size_t n) const {
+		if (!my_started) {
+			my_result = p[0];
+			my_started = true;
+		}
+		my_result = simd::dispatch<T>::min(p, n, my_result);
+	}
+};
+
+template <typename T>
+class simd_max_body : no_assign {
+	T& my_result;
+	bool& my_started;
+public:
+	simd_max_body(T& result, bool& started) : my_result(result), my_started(started) {}
+	void operator()(const T* p, size_t n) const {
+		if (!my_started) {
+			my_result = p[0];
+			my_started = true;
+		}
+		my_result = simd::dispatch<T>::max(p, n, my_result);
+	}
+};
+
+template <typename T>
+class simd_sum_body : no_assign {
+	T& my_result;
+public:
+	simd_sum_body(T& result) : my_result(result) {}
+	void operator()(const T* p, size_t n) const {my_result = simd::dispatch<T>::sum(p, n, my_result);}
+};
+
+}
+
+// Offset of the first element equal to value from the beginning of r, or r.size() when there is none
+template <typename Range>
+size_t simd_find(const Range& r, const typename internal::strip<typename Range::value_type>::type& value) {
+	typedef typename internal::strip<typename Range::value_type>::type T;
+	size_t offset = 0;
+	bool found = false;
+	r.for_each_span(internal::simd_find_body<T>(value, offset, found));
+	return offset;
+}
+
+// Number of elements of r equal to value
+template <typename Range>
+size_t simd_count(const Range& r, const typename internal::strip<typename Range::value_type>::type& value) {
+	typedef typename internal::strip<typename Range::value_type>::type T;
+	size_t count = 0;
+	r.for_each_span(internal::simd_count_body<T>(value, count));
+	return count;
+}
+
+// Smallest element of r; r must not be empty
+template <typename Range>
+typename internal::strip<typename Range::value_type>::type simd_min(const Range& r) {
+	typedef typename internal::strip<typename Range::value_type>::type T;
+	__TBB_ASSERT(!r.empty(), "minimum of an empty range");
+	T result = T();
+	bool started = false;
+	r.for_each_span(internal::simd_min_body<T>(result, started));
+	return result;
+}
+
+// Largest element of r; r must not be empty
+template <typename Range>
+typename internal::strip<typename Range::value_type>::type simd_max(const Range& r) {
+	typedef typename internal::strip<typename Range::value_type>::type T;
+	__TBB_ASSERT(!r.empty(), "maximum of an empty range");
+	T result = T();
+	bool started = false;
+	r.for_each_span(internal::simd_max_body<T>(result, started));
+	return result;
+}
+
+// init plus the sum of the elements of r
+template <typename Range>
+typename internal::strip<typename Range::value_type>::type simd_sum(const Range& r,
+		typename internal::strip<typename Range::value_type>::type init = typename internal::strip<typename Range::value_type>::type()) {
+	typedef typename internal::strip<typename Range::value_type>::type T;
+	r.for_each_span(internal::simd_sum_body<T>(init));
+	return init;
+}
+
+}
+
+#endif /* INCLUDE_TBB_SIMD_SCAN_H_ */
@@ -105,6 +105,7 @@
 
 #define __TBB_CPP11_PRESENT (__cplusplus >= 201103L || _MSC_VER >= 1900)
 #define __TBB_CPP17_FALLTHROUGH_PRESENT (__cplusplus >= 201703L)
+#define __TBB_CPP17_OPTIONAL_PRESENT (__cplusplus >= 201703L)
 #define __TBB_FALLTHROUGH_PRESENT (__TBB_GCC_VERSION >= 70000 && !__INTEL_COMPILER)
 
 #if __INTEL_COMPILER &&  !__INTEL_CXX11_MODE__
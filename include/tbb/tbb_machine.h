@@ -698,6 +698,35 @@ inline void __TBB_AtomicAND(volatile void *operand, uintptr_t addend) {
 }
 #endif
 
+/*
+ * Compare and swap of the 16 byte aligned pair of words at ptr, where the processor has one
+ *
+ * Stores value[0..1] and returns true if ptr holds comparand[0..1], otherwise loads the
+ * pair into comparand and returns false. Full fence. x86-64 only (cmpxchg16b).
+ */
+#ifndef __TBB_CAS16_PRESENT
+#if (__x86_64__ || _M_X64) && (__GNUC__ || _MSC_VER)
+#define __TBB_CAS16_PRESENT 1
+#if _MSC_VER
+#include <intrin.h>
+#endif
+inline bool __TBB_machine_cmpswp16(volatile void *ptr, const int64_t value[2], int64_t comparand[2]) {
+#if _MSC_VER
+  return _InterlockedCompareExchange128(static_cast<volatile __int64*>(ptr), value[1], value[0], comparand) != 0;
+#else
+  bool result;
+  __asm__ __volatile__("lock\n\tcmpxchg16b %1\n\tsetz %0"
+    : "=q"(result), "+m"(*static_cast<volatile int64_t*>(ptr)), "+a"(comparand[0]), "+d"(comparand[1])
+    : "b"(value[0]), "c"(value[1])
+    : "memory", "cc");
+  return result;
+#endif
+}
+#else
+#define __TBB_CAS16_PRESENT 0
+#endif
+#endif
+
 #if __TBB_PREFETCHING
 
 #ifndef __TBB_cl_prefetch
@@ -12,12 +12,21 @@
 
 #if _WIN32||_WIN64
 #include "machine/windows_api.h"
-#elif __linux__
-#include <ctime>
 #else
+#include <time.h>
 #include <sys/time.h>
 #endif
 
+/*
+ * Intervals must not jump with the wall clock, so POSIX systems count on CLOCK_MONOTONIC;
+ * gettimeofday() is only the fallback where clock_gettime() lacks it
+ */
+#if !(_WIN32 || _WIN64) && (__linux__ || defined(CLOCK_MONOTONIC))
+#define __TBB_TICK_COUNT_MONOTONIC 1
+#else
+#define __TBB_TICK_COUNT_MONOTONIC 0
+#endif
+
 namespace tbb {
 
 // Absolute timestamp
@@ -50,7 +59,7 @@ public:
 
 		interval_t& operator-= (const interval_t& i) {
 			value -= i.value;
-			return this;
+			return *this;
 		}
 
 	private:
@@ -61,7 +70,7 @@ public:
 			int rval = QueryPerformanceFrequency(&qpfreq);
 			__TBB_ASSERT_EX(rval, "QueryPerformanceFrequency returned zero");
 			return static_cast<long long> (qpfreq.QuadPart);
-#elif __linux_
+#elif __TBB_TICK_COUNT_MONOTONIC
 			return static_cast<long long>(1E9);
 #else
 			return static_cast<long long>(1E6);
@@ -85,18 +94,18 @@ inline tick_count tick_count::now() {
 	int rval = QueryPerformanceCounter(&qpcnt);
 	__TBB_ASSERT_EX(rval, "QueryPerformanceCounter failed");
 	result.my_count = qpcnt.QuadPart;
-	#elif __linux__
+	#elif __TBB_TICK_COUNT_MONOTONIC
 	struct timespec ts;
-	int status = clock_gettime(CLOCK_REALTIME, &ts);
-	__TBB_ASSERT_EX(status == 0, "CLOCK_REALTIME not supported");
+	int status = clock_gettime(CLOCK_MONOTONIC, &ts);
+	__TBB_ASSERT_EX(status == 0, "CLOCK_MONOTONIC not supported");
 	result.my_count = static_cast<long long>(1000000000UL)*static_cast<long long>(ts.tv_sec)
 	                  + static_cast<long long>(ts.tv_nsec);
 	#else
 	struct timeval tv;
 	int status = gettimeofday(&tv, NULL);
 	__TBB_ASSERT_EX(status == 0, "gettimeofday failed");
-	result.my_count = static_cast<long long>(1000000)*static_cast<long long>(ts.tv_sec)
-	                  + static_cast<long long>(ts.tv_usec);
+	result.my_count = static_cast<long long>(1000000)*static_cast<long long>(tv.tv_sec)
+	                  + static_cast<long long>(tv.tv_usec);
 	#endif
 	return result;
 }